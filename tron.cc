@@ -1,8 +1,18 @@
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #define WIDTH  30
 #define HEIGHT 20
@@ -11,18 +21,107 @@
 #define PLAYERS 4
 #define TIME_LIMIT 80
 #define MAX_NEIGHBOURS 32
+// the most plies by which selective search extends, or reduces, one line
+#define SELECTIVE_PLIES 2
+// the deepest a search may go, and so the most moves the undo journal holds
+#define MAX_PLIES 64
 
-//#define WORST_CASE_TESTING
-#define NO_MANS_LAND
-// Each room which has a neighbour shared with an enemy has its space reduced by this ratio
-#define SHARED_ROOM_PENALTY 9 / 10
-// We get this much extra space for each room which is available to us but which we don't choose to enter
-// #define UNVISITED_ROOM_BONUS 1 / 10
-// Each door we pass through reduces our score by this much
-// #define DOOR_PENALTY 1
 
 using namespace std;
 
+// The evaluation's tunable constants
+enum EvalParam {
+    // Each room which has a neighbour shared with an enemy keeps this percentage of its space
+    SHARED_ROOM_PENALTY,
+    // We get this percentage of the space of each room which is available to us but which we don't choose to enter
+    UNVISITED_ROOM_BONUS,
+    // Each door we pass through reduces our score by this much
+    DOOR_PENALTY,
+    // A player who dies loses this much, shared among the players still alive
+    DEATH_PENALTY,
+    EVAL_PARAMS
+};
+
+const char* const evalParamNames[EVAL_PARAMS] = {
+    "shared_room_penalty", "unvisited_room_bonus", "door_penalty", "death_penalty"
+};
+
+class EvalParams {
+public:
+    int values[EVAL_PARAMS];
+
+    EvalParams() {
+        values[SHARED_ROOM_PENALTY] = 90;
+        values[UNVISITED_ROOM_BONUS] = 10;
+        values[DOOR_PENALTY] = 1;
+        values[DEATH_PENALTY] = 1000;
+    }
+
+    inline int operator[](int param) const {
+        return values[param];
+    }
+
+    inline int& operator[](int param) {
+        return values[param];
+    }
+
+    static int find(const string& name) {
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            if (name == evalParamNames[i]) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Read "name value" lines, leaving unmentioned parameters alone
+    bool read(istream& is) {
+        string name;
+        int value;
+        while (is >> name >> value) {
+            int param = find(name);
+            if (param < 0) {
+                cerr << "Unknown evaluation parameter " << name << endl;
+                return false;
+            }
+            values[param] = value;
+        }
+        return is.eof();
+    }
+
+    void write(ostream& os) const {
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            os << evalParamNames[i] << " " << values[i] << endl;
+        }
+    }
+};
+
+// Which parts of the evaluation and search are switched on. These are compile time choices, so a
+// part which is off costs nothing; the weights of the parts which are on come from EvalParams.
+template <bool p_noMansLand, bool p_sharedRoomPenalty, bool p_unvisitedRoomBonus, bool p_doorPenalty, bool p_worstCase>
+class EvalPolicy {
+public:
+    // Cells on the boundary between two players' regions belong to neither
+    static const bool noMansLand = p_noMansLand;
+    static const bool sharedRoomPenalty = p_sharedRoomPenalty;
+    static const bool unvisitedRoomBonus = p_unvisitedRoomBonus;
+    static const bool doorPenalty = p_doorPenalty;
+    // Opponents choose moves which worsen our rank, over moves which improve their score
+    static const bool worstCase = p_worstCase;
+
+    // bitmask of the EvalParams used
+    static const unsigned params = (sharedRoomPenalty << SHARED_ROOM_PENALTY)
+        | (unvisitedRoomBonus << UNVISITED_ROOM_BONUS) | (doorPenalty << DOOR_PENALTY) | (1 << DEATH_PENALTY);
+};
+
+//                   noMansLand, sharedRoomPenalty, unvisitedRoomBonus, doorPenalty, worstCase
+typedef EvalPolicy<true, true, false, false, false> StandardEval;
+typedef EvalPolicy<false, false, false, false, false> PlainEval;
+typedef EvalPolicy<true, true, true, false, false> BonusEval;
+typedef EvalPolicy<true, true, false, true, false> DoorsEval;
+typedef EvalPolicy<true, true, true, true, false> FullEval;
+typedef EvalPolicy<true, true, false, false, true> WorstCaseEval;
+
 const char* RIGHT = "RIGHT";
 const char* LEFT = "LEFT";
 const char* DOWN = "DOWN";
@@ -40,6 +139,38 @@ long millis() {
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+// CPU time used by the calling thread, for timing several searches running side by side
+long threadMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+inline int moveIndex(const char* move) {
+    for (int i = 0; i < 4; i++) {
+        if (move == dirs[i]) {
+            return i;
+        }
+    }
+    return 4;
+}
+
+inline const char* moveName(int index) {
+    return index >= 0 && index < 4 ? dirs[index] : GULP;
+}
+
 class Player {
 public:
     int x;
@@ -56,9 +187,328 @@ public:
     }
 };
 
-class State {
+// The raw input for one turn, as sent by the referee
+template <int players>
+class BasicTurnInput {
+public:
+    int numPlayers;
+    int thisPlayer;
+    // tail x, tail y, head x, head y for each player
+    int coords[players][4];
+
+    inline void read(istream& is) {
+        is >> numPlayers;
+        is >> thisPlayer;
+        for (int i = 0; i < numPlayers; i++) {
+            for (int j = 0; j < 4; j++) {
+                is >> coords[i][j];
+            }
+        }
+    }
+};
+
+typedef BasicTurnInput<PLAYERS> TurnInput;
+
+// Picks the first type when the condition holds, otherwise the second
+template <bool condition, class IfTrue, class IfFalse>
+class Choose {
+public:
+    typedef IfTrue type;
+};
+
+template <class IfTrue, class IfFalse>
+class Choose<false, IfTrue, IfFalse> {
+public:
+    typedef IfFalse type;
+};
+
+// The dimensions of a board and the most players it hosts, and the smallest types which can index
+// it. The state, the evaluation and the search are templates on the board, so that variants on
+// bigger grids or with more players size every buffer from their own dimensions while the
+// standard board keeps its compact layout.
+template <int p_width, int p_height, int p_players = PLAYERS>
+class BoardSize {
+public:
+    static const int width = p_width;
+    static const int height = p_height;
+    static const int area = p_width * p_height;
+    static const int players = p_players;
+    // A set of players, such as the living, as a bitmask
+    typedef typename Choose<(p_players <= 8), unsigned char,
+        typename Choose<(p_players <= 16), unsigned short, unsigned int>::type>::type PlayerSet;
+    // Coordinates, and flood fill distances. Distances beyond width + height only arise along
+    // winding corridors, where they wrap.
+    typedef typename Choose<(p_width + p_height < 255), unsigned char, unsigned short>::type Coordinate;
+    // Room ids and room sizes, which may also be -1. There is at most one room per cell.
+    typedef typename Choose<(p_width * p_height + p_players < SHRT_MAX), short, int>::type RoomIndex;
+    // Cells are numbered row by row across the grid including its border of walls, so every
+    // neighbour of a board cell is a fixed step away and is itself a cell of the grid
+    static const int stride = p_width + 2;
+    static const int cells = (p_width + 2) * (p_height + 2);
+    typedef typename Choose<(cells <= USHRT_MAX), unsigned short, unsigned int>::type CellIndex;
+    // the step to each neighbour, in the order of dirs
+    static const int neighbourOffsets[4];
+
+    static inline int index(int x, int y) {
+        return (y + 1) * stride + x + 1;
+    }
+
+    static inline int column(int i) {
+        return i % stride - 1;
+    }
+
+    static inline int row(int i) {
+        return i / stride - 1;
+    }
+};
+
+template <int p_width, int p_height, int p_players>
+const int BoardSize<p_width, p_height, p_players>::neighbourOffsets[4] = {1, -1, p_width + 2, -(p_width + 2)};
+
+typedef BoardSize<WIDTH, HEIGHT> StandardBoard;
+
+// splitmix64's finaliser, to spread the bits of each feature of a position
+inline uint64_t mixBits(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// The board's symmetries: bit 0 mirrors it left to right and bit 1 top to bottom, so 3 turns it
+// through 180 degrees. Each is its own inverse.
+#define SYMMETRIES 4
+
+// Random keys for hashing positions on a board: for each player and cell, the keys of the
+// player's trail and head there as seen through each symmetry, side by side so that moving
+// updates every symmetry's hash from one cache line
+template <class Board>
+class BasicZobrist {
+public:
+    uint64_t trail[Board::players][Board::cells][SYMMETRIES];
+    uint64_t head[Board::players][Board::cells][SYMMETRIES];
+
+    BasicZobrist() {
+        memset(trail, 0, sizeof(trail));
+        memset(head, 0, sizeof(head));
+        for (int x = 0; x < Board::width; x++) {
+            for (int y = 0; y < Board::height; y++) {
+                for (int symmetry = 0; symmetry < SYMMETRIES; symmetry++) {
+                    int image = Board::index(symmetry & 1 ? Board::width - 1 - x : x,
+                        symmetry & 2 ? Board::height - 1 - y : y);
+                    for (int player = 0; player < Board::players; player++) {
+                        uint64_t feature = uint64_t(player) << 32 | image;
+                        trail[player][Board::index(x, y)][symmetry] = mixBits(uint64_t(1) << 56 | feature);
+                        head[player][Board::index(x, y)][symmetry] = mixBits(uint64_t(2) << 56 | feature);
+                    }
+                }
+            }
+        }
+    }
+
+    static inline const BasicZobrist& keys() {
+        static const BasicZobrist zobrist;
+        return zobrist;
+    }
+};
+
+// What one move of the search changed, for unmakeMove to put back: the cell a player moved into
+// and where their head was, or that they died. The trail keys change by that cell's keys.
+template <class Board>
+class BasicUndo {
+public:
+    typename Board::CellIndex cell;
+    short fromX;
+    short fromY;
+    signed char player;
+    bool died;
+    // what the grid held for the cell before the move
+    unsigned char covered;
+};
+
+template <class Board>
+class BasicState {
+public:
+    typedef typename Board::PlayerSet PlayerSet;
+    typedef BasicTurnInput<Board::players> TurnInput;
+    typedef BasicUndo<Board> Undo;
+    // what the grid holds for a cell which is not a player's
+    static const unsigned char EMPTY = 255;
+    static const unsigned char WALL = 254;
+
 private:
-    unsigned char grid[WIDTH+2][HEIGHT+2];
+    // Bits, one per cell of the grid, in the order of their index
+    static const int CELL_WORDS = (Board::cells + 63) / 64;
+    static const int WALLS = Board::players;
+
+    // The player whose trail covers each cell, or EMPTY or WALL. Where trails overlap, the last
+    // to arrive.
+    unsigned char grid[Board::cells];
+    // Each player's trail, and the walls, kept up to date as cells change
+    uint64_t trails[Board::players + 1][CELL_WORDS];
+    // The cells which block: the walls and the living players' trails
+    uint64_t occupancy[CELL_WORDS];
+    // From them, when a door is first asked for after a change, the doors on the edges between
+    // cells: horizontalDoors holds the edge from each cell to the next in its row, and
+    // verticalDoors the edge from each cell to the one below it
+    mutable bool doorsStale;
+    mutable uint64_t horizontalDoors[CELL_WORDS];
+    mutable uint64_t verticalDoors[CELL_WORDS];
+    // With hashing on, each player's trail hashed as seen through each symmetry, kept up to date
+    // as cells change. Otherwise keys are worked out afresh from the trails, which is cheaper
+    // unless they are wanted at every node. A dead player's trail drops out of the position's
+    // key, as it does off the board.
+    bool hashing;
+    uint64_t trailKeys[Board::players][SYMMETRIES];
+
+    inline void hashTrail(int player, int i) {
+        const BasicZobrist<Board>& zobrist = BasicZobrist<Board>::keys();
+        for (int symmetry = 0; symmetry < SYMMETRIES; symmetry++) {
+            trailKeys[player][symmetry] ^= zobrist.trail[player][i][symmetry];
+        }
+    }
+
+    uint64_t trailKey(int player, int symmetry) const {
+        if (hashing) {
+            return trailKeys[player][symmetry];
+        }
+        const BasicZobrist<Board>& zobrist = BasicZobrist<Board>::keys();
+        uint64_t key = 0;
+        for (int w = 0; w < CELL_WORDS; w++) {
+            for (uint64_t bits = trails[player][w]; bits; bits &= bits - 1) {
+                key ^= zobrist.trail[player][w * 64 + __builtin_ctzll(bits)][symmetry];
+            }
+        }
+        return key;
+    }
+
+    static inline bool testBit(const uint64_t* bits, int i) {
+        return (bits[i >> 6] >> (i & 63)) & 1;
+    }
+
+    // Word w of the bits of the cells a number of cells on, or back if it is negative; beyond
+    // the grid is clear
+    static inline uint64_t shifted(const uint64_t* bits, int w, int cells) {
+        int low = w + (cells >> 6);
+        int shift = cells & 63;
+        uint64_t lowWord = low >= 0 && low < CELL_WORDS ? bits[low] : 0;
+        if (!shift) {
+            return lowWord;
+        }
+        uint64_t highWord = low + 1 >= 0 && low + 1 < CELL_WORDS ? bits[low + 1] : 0;
+        return lowWord >> shift | highWord << (64 - shift);
+    }
+
+    inline void setTrail(int player, int i, bool set) {
+        uint64_t& word = trails[player][i >> 6];
+        uint64_t bit = uint64_t(1) << (i & 63);
+        word = set ? word | bit : word & ~bit;
+        if (set && isAlive(player)) {
+            occupancy[i >> 6] |= bit;
+        } else if (!set) {
+            // another living player's trail may cover the cell too
+            occupancy[i >> 6] &= ~bit;
+            for (int other = 0; other <= WALLS; other++) {
+                if ((other == WALLS || isAlive(other)) && testBit(trails[other], i)) {
+                    occupancy[i >> 6] |= bit;
+                }
+            }
+        }
+        doorsStale = true;
+    }
+
+    // During a search, when a player dies: only the words their trail touches change, and in
+    // those a cell stays blocked where a wall or another living player's trail covers it too
+    inline void vacateTrail(int player) {
+        for (int w = 0; w < CELL_WORDS; w++) {
+            if (trails[player][w]) {
+                uint64_t covered = trails[WALLS][w];
+                for (int other = 0; other < Board::players; other++) {
+                    if (other != player && isAlive(other)) {
+                        covered |= trails[other][w];
+                    }
+                }
+                occupancy[w] &= ~trails[player][w] | covered;
+            }
+        }
+        doorsStale = true;
+    }
+
+    // and when the death is taken back
+    inline void occupyTrail(int player) {
+        for (int w = 0; w < CELL_WORDS; w++) {
+            occupancy[w] |= trails[player][w];
+        }
+        doorsStale = true;
+    }
+
+    // When a player dies or comes back to life
+    void refreshOccupancy() {
+        memcpy(occupancy, trails[WALLS], sizeof(occupancy));
+        for (int player = 0; player < Board::players; player++) {
+            if (isAlive(player)) {
+                for (int w = 0; w < CELL_WORDS; w++) {
+                    occupancy[w] |= trails[player][w];
+                }
+            }
+        }
+        doorsStale = true;
+    }
+
+    // A player's trail no longer covers a cell, so it shows whoever else's still does
+    inline void uncover(int player, int i) {
+        if (grid[i] != player) {
+            return;
+        }
+        grid[i] = EMPTY;
+        for (int other = 0; other < Board::players; other++) {
+            if (testBit(trails[other], i)) {
+                grid[i] = other;
+            }
+        }
+    }
+
+    // The whole board in one pass of shifted bits. Moving right from a cell passes through a door
+    // when a cell above it or its neighbour is blocked and so is a cell below either; moving down,
+    // when a cell to the left of either is blocked and so is one to the right.
+    void refreshDoors() const {
+        // either of a cell and the next in its row, or the next in its column, is blocked
+        uint64_t across[CELL_WORDS];
+        uint64_t down[CELL_WORDS];
+        for (int w = 0; w < CELL_WORDS; w++) {
+            across[w] = occupancy[w] | shifted(occupancy, w, 1);
+            down[w] = occupancy[w] | shifted(occupancy, w, Board::stride);
+        }
+        for (int w = 0; w < CELL_WORDS; w++) {
+            horizontalDoors[w] = shifted(across, w, -Board::stride) & shifted(across, w, Board::stride);
+            verticalDoors[w] = shifted(down, w, -1) & shifted(down, w, 1);
+        }
+        doorsStale = false;
+    }
+
+    // Whether a cell blocks, where beyond the grid is clear as it is for shifted
+    inline bool blocks(int i) const {
+        return i >= 0 && i < Board::cells && testBit(occupancy, i);
+    }
+
+    // When cell i alone has changed since the doors were worked out, the only edges whose doors
+    // change are those which look at it, across the rows and columns next to it
+    void patchDoors(int i) const {
+        const int s = Board::stride;
+        const int across[4] = {i - s - 1, i - s, i + s - 1, i + s};
+        const int down[4] = {i - s - 1, i - s + 1, i - 1, i + 1};
+        for (int k = 0; k < 4; k++) {
+            int c = across[k];
+            bool door = (blocks(c - s) || blocks(c - s + 1)) && (blocks(c + s) || blocks(c + s + 1));
+            uint64_t bit = uint64_t(1) << (c & 63);
+            horizontalDoors[c >> 6] = door ? horizontalDoors[c >> 6] | bit : horizontalDoors[c >> 6] & ~bit;
+            c = down[k];
+            door = (blocks(c - 1) || blocks(c - 1 + s)) && (blocks(c + 1) || blocks(c + 1 + s));
+            bit = uint64_t(1) << (c & 63);
+            verticalDoors[c >> 6] = door ? verticalDoors[c >> 6] | bit : verticalDoors[c >> 6] & ~bit;
+        }
+        doorsStale = false;
+    }
 
 public:
     int numPlayers;
@@ -66,45 +516,92 @@ public:
     int maxDepth;
     int pruneMargin;
     bool pruningEnabled;
+    // Selective search: a move which leaves the mover's head within this many cells of another
+    // head, or passes through a door, is searched a ply deeper, and a player whose region meets
+    // no other within this many steps of their head is searched a ply shallower. 0 for off.
+    int selectiveRange;
+    // the plies added to maxDepth, less those taken away, along the line being searched
+    int depthAdjustment;
+    // the turns along the line being searched which passed because the player was dead or not
+    // searched, which do not count towards the depth
+    int passes;
+    // Search only our group of players, whose regions meet ours, and let the others pass. Off
+    // unless asked for, as passing turns then cost no plies, which deepens the search.
+    bool decompositionEnabled;
+    // the players whose moves are searched; the others pass, as the dead do
+    PlayerSet moving;
     int nodesSearched;
+    // search nodes per move, 0 for no limit
+    int nodeLimit;
     bool timeLimitEnabled;
+    // milliseconds per move, measured by the clock function
+    int timeLimit;
+    long (*clock)();
     long startTime;
     bool timeLimitReached;
-    Player players[PLAYERS];
+    Player players[Board::players];
     // this is a bitmask of living players
-    unsigned char alive;
+    PlayerSet alive;
     int deathCount;
     // a list of the players who have died, in chronological order of death
-    int deadList[PLAYERS];
-
-    State() {
-        memset(grid, 0, (WIDTH + 2) * (HEIGHT + 2) * sizeof(char));
-        for (int x = 0; x < WIDTH + 2; x++) {
-            grid[x][0] = grid[x][HEIGHT + 1] = 255;
-        }
-        for (int y = 0; y < HEIGHT + 2; y++) {
-            grid[0][y] = grid[WIDTH + 1][y] = 255;
+    int deadList[Board::players];
+    // The moves made by makeMove and makeDeath and not yet unmade, oldest first, so that anything
+    // which follows the search incrementally can see what changed
+    Undo journal[MAX_PLIES];
+    int journalSize;
+
+    BasicState() {
+        memset(grid, EMPTY, sizeof(grid));
+        memset(trails, 0, sizeof(trails));
+        hashing = false;
+        memset(trailKeys, 0, sizeof(trailKeys));
+        for (int i = 0; i < Board::cells; i++) {
+            int x = Board::column(i);
+            int y = Board::row(i);
+            if (x < 0 || x >= Board::width || y < 0 || y >= Board::height) {
+                grid[i] = WALL;
+                trails[WALLS][i >> 6] |= uint64_t(1) << (i & 63);
+            }
         }
+        memcpy(occupancy, trails[WALLS], sizeof(occupancy));
         maxDepth = 8;
         pruneMargin = 0;
         pruningEnabled = false;
+        selectiveRange = 0;
+        depthAdjustment = 0;
+        passes = 0;
+        decompositionEnabled = false;
+        moving = PlayerSet(~0);
         nodesSearched = 0;
+        nodeLimit = 0;
         timeLimitEnabled = true;
-        alive = 255;
+        timeLimit = TIME_LIMIT;
+        clock = millis;
+        alive = PlayerSet(~0);
         deathCount = 0;
+        journalSize = 0;
+        // the doors are worked out when first needed
+        doorsStale = true;
         resetTimer();
     }
 
     inline void resetTimer() {
-        startTime = millis();
+        startTime = clock();
         timeLimitReached = false;
     }
 
+    // Stop each search after a number of nodes instead of a time, or never for 0. The search then
+    // depends on nothing but the position, so it plays the same moves on any machine under any load.
+    void setNodeBudget(int nodes) {
+        nodeLimit = nodes;
+        timeLimitEnabled = false;
+    }
+
     inline int getMaxDepth() {
-        if (isTimeLimitReached()) {
+        if (isTimeLimitReached() || (nodeLimit && nodesSearched >= nodeLimit)) {
             return 1;
         } else {
-            return maxDepth;
+            return min(maxDepth + depthAdjustment, MAX_PLIES) + passes;
         }
     }
 
@@ -113,7 +610,7 @@ public:
             return false;
         } else if (timeLimitReached) {
             return true;
-        } else if (millis() - startTime >= TIME_LIMIT) {
+        } else if (clock() - startTime >= timeLimit) {
             timeLimitReached = true;
             return true;
         } else {
@@ -123,45 +620,72 @@ public:
 
     // Starting from (x,y), move towards xOffset OR yOffset, and find out whether we pass through a door
     inline bool isDoor(int x, int y, int xOffset, int yOffset) const {
-        if (xOffset) {
-            bool above = occupied(x, y - 1) || occupied(x + xOffset, y - 1);
-            bool below = occupied(x, y + 1) || occupied(x + xOffset, y + 1);
-            return above && below;
+#ifdef TRON_DEBUG
+        if (!xOffset && !yOffset) {
+            cerr << "Illegal arguments to isDoor" << endl;
+            return false;
         }
-#ifdef TRON_TRACE
-        if (yOffset) {
 #endif
-            bool left = occupied(x - 1, y) || occupied(x - 1, y + yOffset);
-            bool right = occupied(x + 1, y) || occupied(x + 1, y + yOffset);
-            return left && right;
-#ifdef TRON_TRACE
+        return isDoor(Board::index(x, y), xOffset + yOffset * Board::stride);
+    }
+
+    // The same from cell i, stepping by one of the board's neighbour offsets
+    inline bool isDoor(int i, int offset) const {
+        if (doorsStale) {
+            refreshDoors();
         }
-        cerr << "Illegal arguments to isDoor" << endl;
-        return false;
-#endif
+        return testBit(offset == 1 || offset == -1 ? horizontalDoors : verticalDoors, min(i, i + offset));
     }
 
     inline bool occupied(int x, int y) const {
-        return grid[x + 1][y + 1] & alive;
+        return testBit(occupancy, Board::index(x, y));
+    }
+
+    inline bool occupied(int i) const {
+        return testBit(occupancy, i);
+    }
+
+    // The living player whose trail covers a cell, or EMPTY or WALL; dead players' trails are gone
+    inline int cell(int x, int y) const {
+        int owner = grid[Board::index(x, y)];
+        return owner < Board::players && !isAlive(owner) ? EMPTY : owner;
     }
 
     inline void occupy(int x, int y, int player) {
         players[player].x = x;
         players[player].y = y;
 
-        grid[x + 1][y + 1] |= (1 << player);
+        int i = Board::index(x, y);
+        if (hashing && !testBit(trails[player], i)) {
+            hashTrail(player, i);
+        }
+        grid[i] = player;
+        setTrail(player, i, true);
     }
 
     inline void unoccupy(int x, int y, int player) {
-        grid[x + 1][y + 1] &= ~(1 << player);
+        int i = Board::index(x, y);
+        if (hashing && testBit(trails[player], i)) {
+            hashTrail(player, i);
+        }
+        setTrail(player, i, false);
+        uncover(player, i);
     }
 
     inline void clear(int x, int y) {
-        grid[x + 1][y + 1] = 0;
+        int i = Board::index(x, y);
+        for (int player = 0; player < Board::players; player++) {
+            if (hashing && testBit(trails[player], i)) {
+                hashTrail(player, i);
+            }
+            setTrail(player, i, false);
+        }
+        grid[i] = EMPTY;
     }
 
     inline void kill(int player) {
-        alive &= ~(1 << player);
+        alive &= ~(PlayerSet(1) << player);
+        refreshOccupancy();
         for (int i = 0; i < deathCount; i++) {
             if (deadList[i] == player) {
                 // already dead
@@ -172,15 +696,111 @@ public:
     }
 
     inline void revive(int player) {
-        alive |= (1 << player);
+        alive |= PlayerSet(1) << player;
         deathCount--;
+        refreshOccupancy();
+    }
+
+    // Move a living player into a free cell, recording the move in the journal
+    inline void makeMove(int player, int x, int y) {
+        int i = Board::index(x, y);
+        Undo& undo = journal[journalSize++];
+        undo.cell = i;
+        undo.fromX = players[player].x;
+        undo.fromY = players[player].y;
+        undo.player = player;
+        undo.died = false;
+        undo.covered = grid[i];
+        players[player].x = x;
+        players[player].y = y;
+        // the cell is free, so the player's trail cannot already cover it
+        if (hashing) {
+            hashTrail(player, i);
+        }
+        grid[i] = player;
+        setTrail(player, i, true);
+    }
+
+    // A living player with no move dies, recording the death in the journal
+    inline void makeDeath(int player) {
+        Undo& undo = journal[journalSize++];
+        undo.player = player;
+        undo.died = true;
+        alive &= ~(PlayerSet(1) << player);
+        deadList[deathCount++] = player;
+        vacateTrail(player);
+    }
+
+    // Take back the last move or death in the journal
+    inline void unmakeMove() {
+        const Undo& undo = journal[--journalSize];
+        int player = undo.player;
+        if (undo.died) {
+            alive |= PlayerSet(1) << player;
+            deathCount--;
+            occupyTrail(player);
+            return;
+        }
+        if (hashing) {
+            hashTrail(player, undo.cell);
+        }
+        // the cell was free before the move, though a dead player's trail may still cover it
+        grid[undo.cell] = undo.covered;
+        trails[player][undo.cell >> 6] &= ~(uint64_t(1) << (undo.cell & 63));
+        occupancy[undo.cell >> 6] &= ~(uint64_t(1) << (undo.cell & 63));
+        doorsStale = true;
+        players[player].x = undo.fromX;
+        players[player].y = undo.fromY;
+    }
+
+    // Work out the doors now, if they are stale, so that moves from this position can patch them
+    inline void refreshDoorsNow() const {
+        if (doorsStale) {
+            refreshDoors();
+        }
+    }
+
+    // As makeMove and unmakeMove, but doors which were up to date are patched around the cell
+    // rather than left to be worked out again for the whole board
+    inline void makeMovePatchingDoors(int player, int x, int y) {
+        bool fresh = !doorsStale;
+        makeMove(player, x, y);
+        if (fresh) {
+            patchDoors(Board::index(x, y));
+        }
+    }
+
+    inline void unmakeMovePatchingDoors() {
+        bool fresh = !doorsStale;
+        int i = journal[journalSize - 1].cell;
+        bool died = journal[journalSize - 1].died;
+        unmakeMove();
+        if (fresh && !died) {
+            patchDoors(i);
+        }
     }
 
     inline bool isAlive(int player) const {
-        return alive & (1 << player);
+        return alive & (PlayerSet(1) << player);
+    }
+
+    // Whether a player is alive and their moves are searched
+    inline bool isMoving(int player) const {
+        return alive & moving & (PlayerSet(1) << player);
+    }
+
+    // Whether a player's head is within selectiveRange cells of another living player's head
+    inline bool inContact(int player) const {
+        for (int i = 0; i < numPlayers; i++) {
+            if (i != player && isAlive(i) && abs(players[i].x - players[player].x)
+                    + abs(players[i].y - players[player].y) <= selectiveRange) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    inline int livingCount() {
+    inline int livingCount() const {
         return numPlayers - deathCount;
     }
 
@@ -193,19 +813,20 @@ public:
     }
 
     inline void readTurn(istream& is) {
-        is >> numPlayers;
-        is >> thisPlayer;
+        TurnInput input;
+        input.read(is);
+        applyTurn(input);
+    }
 
-        for (int i = 0; i < numPlayers; i++) {
-            int tailX;
-            int tailY;
-            int headX;
-            int headY;
+    inline void applyTurn(const TurnInput& input) {
+        numPlayers = input.numPlayers;
+        thisPlayer = input.thisPlayer;
 
-            is >> tailX;
-            is >> tailY;
-            is >> headX;
-            is >> headY;
+        for (int i = 0; i < numPlayers; i++) {
+            int tailX = input.coords[i][0];
+            int tailY = input.coords[i][1];
+            int headX = input.coords[i][2];
+            int headY = input.coords[i][3];
 
             if (headX < 0 || (players[i].x == headX && players[i].y == headY)) {
                 // Player is already dead
@@ -220,10 +841,71 @@ public:
         nodesSearched = 0;
     }
 
+    // Keep the keys up to date move by move, for when one is wanted at every node
+    void setHashing(bool enabled) {
+        hashing = false;
+        for (int player = 0; player < Board::players; player++) {
+            for (int symmetry = 0; symmetry < SYMMETRIES; symmetry++) {
+                trailKeys[player][symmetry] = trailKey(player, symmetry);
+            }
+        }
+        hashing = enabled;
+    }
+
+    // A hash of the position as seen through a symmetry: whose turn it is, each living player's
+    // trail and head, and the order in which the others died
+    uint64_t key(int symmetry) const {
+        const BasicZobrist<Board>& zobrist = BasicZobrist<Board>::keys();
+        uint64_t key = mixBits(uint64_t(numPlayers) << 8 | thisPlayer);
+        for (int i = 0; i < numPlayers; i++) {
+            if (isAlive(i)) {
+                key ^= trailKey(i, symmetry) ^ zobrist.head[i][Board::index(players[i].x, players[i].y)][symmetry];
+            }
+        }
+        for (int i = 0; i < deathCount; i++) {
+            key ^= mixBits(uint64_t(3) << 56 | uint64_t(deadList[i]) << 32 | i);
+        }
+        return key;
+    }
+
+    // The same key for every symmetric image of a position: the least over the symmetries. The
+    // symmetry which gave it maps moves between the position and its canonical image.
+    uint64_t canonicalKey(int& symmetry) const {
+        uint64_t best = key(0);
+        symmetry = 0;
+        for (int s = 1; s < SYMMETRIES; s++) {
+            uint64_t k = key(s);
+            if (k < best) {
+                best = k;
+                symmetry = s;
+            }
+        }
+        return best;
+    }
+
+    // Whether the board, heads and deaths match another state (search bookkeeping is ignored)
+    bool sameBoard(const BasicState& other) const {
+        if (memcmp(grid, other.grid, sizeof(grid)) != 0 || memcmp(trails, other.trails, sizeof(trails)) != 0 || alive != other.alive || deathCount != other.deathCount
+                || numPlayers != other.numPlayers) {
+            return false;
+        }
+        for (int i = 0; i < deathCount; i++) {
+            if (deadList[i] != other.deadList[i]) {
+                return false;
+            }
+        }
+        for (int i = 0; i < numPlayers; i++) {
+            if (players[i].x != other.players[i].x || players[i].y != other.players[i].y) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     void print() {
-        for (int y = 0; y < HEIGHT; y++) {
+        for (int y = 0; y < Board::height; y++) {
             cerr << "\"";
-            for (int x = 0; x < WIDTH; x++) {
+            for (int x = 0; x < Board::width; x++) {
                 int player = -1;
                 for (int i = 0; i < numPlayers; i++) {
                     if (x == players[i].x && y == players[i].y) {
@@ -233,68 +915,496 @@ public:
                 }
                 if (player >= 0) {
                     cerr << char('A' + player);
+                } else if (grid[Board::index(x, y)] == EMPTY) {
+                    cerr << ' ';
                 } else {
-                    unsigned char b = grid[x + 1][y + 1];
-                    if (b == 0) {
-                        cerr << ' ';
-                    } else {
-                        int p = 0;
-                        while (b >>= 1) p++;
-                        cerr << p;
-                    }
+                    cerr << int(grid[Board::index(x, y)]);
                 }
             }
             cerr << "\\n\"" << endl;
         }
     }
-};
+};
+
+typedef BasicState<StandardBoard> State;
+
+// Search statistics, compiled in with -DTRON_STATS. Without it the counting and timing macros
+// expand to nothing.
+#define STATS_DEPTHS 32
+
+enum StatsPhase {
+    PHASE_SEARCH,
+    PHASE_EVALUATE,
+    PHASE_FLOOD,
+    PHASE_REGION_SIZES,
+    STATS_PHASES
+};
+
+const char* const statsPhaseNames[STATS_PHASES] = {"search", "evaluate", "flood", "region sizes"};
+
+// Plain data, so that each thread can have its own copy
+struct SearchStats {
+    long nodes[STATS_DEPTHS];
+    long leaves;
+    long cellsExpanded;
+    long roomsCreated;
+    long roomsCombined;
+    long regionSizeCalls;
+    long cutoffs;
+    long cacheHits;
+    long phaseTime[STATS_PHASES];    // nanoseconds
+
+    void reset() {
+        memset(this, 0, sizeof(SearchStats));
+    }
+
+    void print(ostream& os, int turn) const {
+        long totalNodes = 0;
+        for (int i = 0; i < STATS_DEPTHS; i++) {
+            totalNodes += nodes[i];
+        }
+        os << "turn " << turn << ": " << totalNodes << " nodes (by depth";
+        for (int i = 0; i < STATS_DEPTHS && nodes[i]; i++) {
+            os << " " << nodes[i];
+        }
+        os << "), " << leaves << " leaves, " << cellsExpanded << " cells, " << roomsCreated << " rooms, "
+            << roomsCombined << " combines, " << regionSizeCalls << " region size calls, " << cutoffs << " cutoffs, "
+            << cacheHits << " cache hits;";
+        for (int i = 0; i < STATS_PHASES; i++) {
+            os << " " << statsPhaseNames[i] << " " << fixed << setprecision(3) << phaseTime[i] / 1e6 << "ms";
+        }
+        os << endl;
+    }
+};
+
+#ifdef TRON_STATS
+__thread SearchStats searchStats;
+
+// Adds the time until it goes out of scope to a phase
+class PhaseTimer {
+private:
+    StatsPhase phase;
+    long start;
+
+public:
+    inline PhaseTimer(StatsPhase p_phase) : phase(p_phase), start(nanos()) {}
+
+    inline ~PhaseTimer() {
+        searchStats.phaseTime[phase] += nanos() - start;
+    }
+};
+
+#define STATS_ADD(counter, n) (searchStats.counter += (n))
+#define STATS_INC(counter) (searchStats.counter++)
+#define STATS_TIMER(phase) PhaseTimer phaseTimer(phase)
+#define STATS_RESET() searchStats.reset()
+#define STATS_REPORT(os, turn) searchStats.print(os, turn)
+#else
+#define STATS_ADD(counter, n)
+#define STATS_INC(counter)
+#define STATS_TIMER(phase)
+#define STATS_RESET()
+#define STATS_REPORT(os, turn)
+#endif
+
+// Search tracing. A thread traces while its tracer is set, recording compact events into a ring
+// buffer which keeps the most recent ones; tron_trace turns a dump back into the search tree.
+enum TraceEventType {
+    TRACE_ENTER,     // a node for player at turn
+    TRACE_SKIP,      // the player is dead or alone, so passes
+    TRACE_MOVE,      // the player tries move
+    TRACE_LEAF,      // evaluation at turn, with scores
+    TRACE_SCORE,     // the scores which move led to
+    TRACE_PRUNE,     // the scores which move led to break a bound, ending the node
+    TRACE_CHOOSE,    // the player's best move and its scores
+    TRACE_DIE        // the player has no move
+};
+
+struct TraceEvent {
+    uint8_t type;
+    uint8_t turn;
+    uint8_t player;
+    uint8_t move;
+    int16_t scores[PLAYERS];
+    uint32_t sequence;
+};
+
+#define TRACE_MAGIC "TRNT"
+
+// Precedes the events of one traced turn in a trace file
+struct TraceHeader {
+    char magic[4];
+    int32_t turn;
+    uint32_t events;
+    uint32_t dropped;    // older events overwritten in the ring
+    int8_t numPlayers;
+    int8_t thisPlayer;
+    int8_t maxDepth;
+    uint8_t pad[13];
+};
+
+class Tracer {
+private:
+    TraceEvent* events;
+    unsigned long mask;
+    unsigned long count;
+
+public:
+    Tracer(int capacityBits = 16) {
+        events = new TraceEvent[1 << capacityBits];
+        mask = (1 << capacityBits) - 1;
+        count = 0;
+    }
+
+    ~Tracer() {
+        delete[] events;
+    }
+
+    inline void clear() {
+        count = 0;
+    }
+
+    inline void record(int type, int turn, int player, int move, const int* scores, int numPlayers) {
+        TraceEvent& event = events[count & mask];
+        event.type = type;
+        event.turn = turn;
+        event.player = player;
+        event.move = move;
+        // events keep the scores of the first PLAYERS players
+        for (int i = 0; i < min(numPlayers, PLAYERS); i++) {
+            event.scores[i] = max(-32768, min(32767, scores[i]));
+        }
+        event.sequence = count++;
+    }
+
+    // Write the events, oldest first
+    void write(FILE* file, int turn, int numPlayers, int thisPlayer, int maxDepth) const {
+        unsigned long kept = min(count, mask + 1);
+        TraceHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TRACE_MAGIC, 4);
+        header.turn = turn;
+        header.events = kept;
+        header.dropped = count - kept;
+        header.numPlayers = numPlayers;
+        header.thisPlayer = thisPlayer;
+        header.maxDepth = maxDepth;
+        fwrite(&header, sizeof(header), 1, file);
+        unsigned long first = (count - kept) & mask;
+        unsigned long tail = min(kept, mask + 1 - first);
+        fwrite(events + first, sizeof(TraceEvent), tail, file);
+        fwrite(events, sizeof(TraceEvent), kept - tail, file);
+        fflush(file);
+    }
+};
+
+// The calling thread's tracer, or 0 when it is not tracing
+__thread Tracer* tracer;
+
+#define TRACE(type, turn, player, move, scores, numPlayers) do {            \
+        if (tracer) {                                                       \
+            tracer->record(type, turn, player, move, scores, numPlayers);   \
+        }                                                                   \
+    } while (0)
+
+// Tables built offline, such as the opening book, are a TableHeader, the entries sorted by key,
+// and then an index of where each bucket of keys starts in the entries: bucket b holds the keys
+// whose top bucketBits bits are b, from starts[b] to starts[b + 1]. A file is mapped and searched
+// in place. Every entry begins with its 64 bit key.
+struct TableHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t width;
+    uint8_t height;
+    uint8_t players;
+    uint8_t bucketBits;
+    uint8_t pad[2];
+    uint32_t entries;
+};
+
+inline uint32_t tableBucket(uint64_t key, int bucketBits) {
+    return bucketBits ? uint32_t(key >> (64 - bucketBits)) : 0;
+}
+
+template <class Entry>
+class MappedTable {
+private:
+    const char* data;
+    size_t size;
+    const Entry* entries;
+    const uint32_t* starts;
+    int bucketBits;
+
+public:
+    MappedTable() {
+        data = 0;
+        size = 0;
+        entries = 0;
+        starts = 0;
+        bucketBits = 0;
+    }
+
+    ~MappedTable() {
+        close();
+    }
+
+    bool open(const char* path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(TableHeader)) {
+            ::close(fd);
+            return false;
+        }
+        const char* mapped = (const char*) mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        const TableHeader& header = *(const TableHeader*) mapped;
+        size_t expected = sizeof(TableHeader) + header.entries * sizeof(Entry)
+            + ((size_t(1) << header.bucketBits) + 1) * sizeof(uint32_t);
+        if (memcmp(header.magic, Entry::magic, 4) != 0 || header.version != Entry::version || header.width != WIDTH
+                || header.height != HEIGHT || header.players != PLAYERS || header.bucketBits > 32
+                || (size_t) st.st_size != expected) {
+            munmap((void*) mapped, st.st_size);
+            return false;
+        }
+        // find reads the entries from each bucket's start to the next, which must stay in the table
+        const uint32_t* bucketStarts = (const uint32_t*) (mapped + sizeof(TableHeader) + header.entries * sizeof(Entry));
+        for (size_t b = 0; b <= (size_t(1) << header.bucketBits); b++) {
+            if (bucketStarts[b] > header.entries || (b > 0 && bucketStarts[b] < bucketStarts[b - 1])) {
+                munmap((void*) mapped, st.st_size);
+                return false;
+            }
+        }
+        data = mapped;
+        size = st.st_size;
+        entries = (const Entry*) (data + sizeof(TableHeader));
+        starts = (const uint32_t*) (entries + header.entries);
+        bucketBits = header.bucketBits;
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap((void*) data, size);
+            data = 0;
+        }
+    }
+
+    inline bool isOpen() const {
+        return data != 0;
+    }
+
+    const Entry* find(uint64_t key) const {
+        uint32_t bucket = tableBucket(key, bucketBits);
+        for (uint32_t i = starts[bucket]; i < starts[bucket + 1]; i++) {
+            if (entries[i].key == key) {
+                return &entries[i];
+            }
+        }
+        return 0;
+    }
+};
+
+#define POCKET_CELLS 24
+
+// The free cells which only one player can reach, relative to its head, when there are few
+// enough of them to look up how many it can fill
+class Pocket {
+public:
+    int size;
+    int dx[POCKET_CELLS];
+    int dy[POCKET_CELLS];
+
+    Pocket() {
+        size = 0;
+    }
+
+    inline void add(int x, int y) {
+        dx[size] = x;
+        dy[size] = y;
+        size++;
+    }
+
+    // The same key for a pocket in any of its eight orientations: the least over them of a sum of
+    // hashed cells. Bit 0 of an orientation transposes the cells, bit 1 negates x and bit 2 y.
+    uint64_t key() const {
+        uint64_t best = 0;
+        for (int orientation = 0; orientation < 8; orientation++) {
+            uint64_t key = mixBits(size);
+            for (int i = 0; i < size; i++) {
+                int x = orientation & 1 ? dy[i] : dx[i];
+                int y = orientation & 1 ? dx[i] : dy[i];
+                x = orientation & 2 ? -x : x;
+                y = orientation & 4 ? -y : y;
+                key += mixBits(uint64_t(x + 64) << 8 | (y + 64));
+            }
+            if (orientation == 0 || key < best) {
+                best = key;
+            }
+        }
+        return best;
+    }
+};
+
+struct PocketEntry {
+    static const char magic[5];
+    static const int version = 1;
+
+    uint64_t key;
+    uint8_t fill;           // the most cells a player can visit from its head
+    uint8_t pad[7];
+
+    inline bool operator<(const PocketEntry& other) const {
+        return key < other.key;
+    }
+};
+
+const char PocketEntry::magic[5] = "TRNP";
+
+// The exact fill of small pockets, from tron_pockets, if one was opened at startup
+MappedTable<PocketEntry> pocketTable;
+
+// Leaf scores by the key of the position and the player who floods first. Direct mapped: a
+// position replaces whatever shared its slot. Empty, and never hit, until given a size.
+template <int players>
+class BasicEvalCache {
+private:
+    struct Entry {
+        uint64_t key;
+        int scores[players];
+        unsigned char regions[players];
+    };
+
+    Entry* entries;
+    uint64_t mask;
+
+    BasicEvalCache(const BasicEvalCache&);
+    BasicEvalCache& operator=(const BasicEvalCache&);
+
+public:
+    BasicEvalCache() : entries(0), mask(0) {}
+
+    ~BasicEvalCache() {
+        delete[] entries;
+    }
+
+    // 2^bits entries, or none
+    void resize(int bits) {
+        delete[] entries;
+        entries = bits > 0 ? new Entry[size_t(1) << bits] : 0;
+        mask = bits > 0 ? (uint64_t(1) << bits) - 1 : 0;
+        clear();
+    }
+
+    void clear() {
+        if (entries) {
+            memset(entries, 0, (mask + 1) * sizeof(Entry));
+        }
+    }
 
-class Vor {
-public:
-    unsigned char player;
-    unsigned char distance;
-    unsigned short room;
+    inline bool isOpen() const {
+        return entries != 0;
+    }
+
+    inline bool find(uint64_t key, int* scores, int* regions, int numPlayers) const {
+        const Entry& entry = entries[key & mask];
+        if (entry.key != key) {
+            return false;
+        }
+        // an entry holds at most the board's players
+        int n = min(numPlayers, players);
+        memcpy(scores, entry.scores, n * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            regions[i] = entry.regions[i];
+        }
+        return true;
+    }
+
+    inline void store(uint64_t key, const int* scores, const int* regions, int numPlayers) {
+        Entry& entry = entries[key & mask];
+        entry.key = key;
+        int n = min(numPlayers, players);
+        memcpy(entry.scores, scores, n * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            entry.regions[i] = regions[i];
+        }
+    }
 };
 
-class Coord {
+// Each evaluator made by an EvalVariant caches 2^evalCacheBits leaves, or none if it is 0. Set
+// at startup, before the evaluators are made.
+int evalCacheBits = 0;
+
+// One cell of the Voronoi diagram, gathered from its planes
+template <class Board>
+class BasicVor {
 public:
-    unsigned char x;
-    unsigned char y;
+    unsigned char player;
+    typename Board::Coordinate distance;
+    typename Board::RoomIndex room;
 };
 
-class Room {
+template <class Board>
+class BasicRoom {
 public:
-    short size;
+    typename Board::RoomIndex size;
     short neighbourCount;
-    short neighbours[MAX_NEIGHBOURS];
+    typename Board::RoomIndex neighbours[MAX_NEIGHBOURS];
     bool shared;
     bool visited;
 };
 
-class Voronoi {
+typedef BasicVor<StandardBoard> Vor;
+typedef BasicRoom<StandardBoard> Room;
+
+template <class Policy, class Board = StandardBoard>
+class BasicVoronoi {
+public:
+    typedef BasicState<Board> State;
+    typedef BasicVor<Board> Vor;
+    typedef BasicRoom<Board> Room;
+
 private:
-    int sizes[PLAYERS];
-    int regions[PLAYERS];
-    Vor grid[WIDTH][HEIGHT];
-    Coord openNodes[10000];
-    Room rooms[10000];
+    typedef typename Board::CellIndex CellIndex;
+    // every cell is opened at most once, and every room but the players' starts at a door cell
+    static const int MAX_ROOMS = Board::area + Board::players;
+
+    int sizes[Board::players];
+    int regions[Board::players];
+    // free cells each player reached first, and the steps from their head to the nearest cell
+    // next to another player's, or INT_MAX if they met no other player
+    int reached[Board::players];
+    int contact[Board::players];
+    // Each cell's player, its distance from their head and its room, by the board's cell index.
+    // Only the owners are reset: the others are written when a cell is first reached.
+    unsigned char owner[Board::cells];
+    typename Board::Coordinate distance[Board::cells];
+    typename Board::RoomIndex roomOf[Board::cells];
+    CellIndex openNodes[Board::area];
+    int openCount;
+    Room rooms[MAX_ROOMS];
     int roomCount;
-    short equivalences[600];
+    typename Board::RoomIndex equivalences[MAX_ROOMS];
 
     void clear() {
-        memset(grid, 255, sizeof(grid));
-        memset(equivalences, -1, sizeof(equivalences));
+        memset(owner, 255, sizeof(owner));
         roomCount = 0;
     }
 
-    #define addNode(xx, yy) {            \
-        openNodes[nodeCount].x = xx;     \
-        openNodes[nodeCount].y = yy;     \
-        nodeCount++;                     \
+    #define addNode(i) {                 \
+        openNodes[nodeCount++] = i;      \
     }
 
     inline int addRoom() {
+        STATS_INC(roomsCreated);
         int id = roomCount++;
+        equivalences[id] = -1;
         Room& room = rooms[id];
         room.size = 0;
         room.neighbourCount = 0;
@@ -303,6 +1413,17 @@ private:
         return id;
     }
 
+    // Regions are joined as players meet, each pointing towards the lowest player of its region
+    inline void joinRegions(int player1, int player2) {
+        int region1 = regionForPlayer(player1);
+        int region2 = regionForPlayer(player2);
+        if (region1 < region2) {
+            regions[region2] = region1;
+        } else if (region2 < region1) {
+            regions[region1] = region2;
+        }
+    }
+
     inline int trueId(int id) {
         do {
             register int equiv = equivalences[id];
@@ -319,7 +1440,7 @@ private:
 
     inline void makeNeighbours(int fromId, int toId) {
         Room& from = room(fromId);
-#ifdef TRON_TRACE
+#ifdef TRON_DEBUG
         if (from.neighbourCount >= MAX_NEIGHBOURS) {
             cerr << "Neighbour limit reached" << endl;
             return;
@@ -332,7 +1453,8 @@ private:
     }
 
     inline void combineRooms(int id1, int id2) {
-#ifdef TRON_TRACE
+        STATS_INC(roomsCombined);
+#ifdef TRON_DEBUG
         if (id1 == id2) {
             cerr << "Room cannot be combined with itself" << endl;
             return;
@@ -346,7 +1468,7 @@ private:
             combinedId = id2;
             oldId = id1;
         }
-#ifdef TRON_TRACE
+#ifdef TRON_DEBUG
         if (trueId(oldId) == trueId(combinedId)) {
             cerr << "Room " << oldId << " already combined with " << combinedId << endl;
             return;
@@ -380,10 +1502,11 @@ private:
     }
 
     int calculateRegionSize(Room& room) {
+        STATS_INC(regionSizeCalls);
         if (room.visited) {
             return 0;
         }
-#ifdef TRON_TRACE
+#ifdef TRON_DEBUG
         if (room.size < 0) {
             cerr << "Dead room while calculating region size" << endl;
         }
@@ -396,11 +1519,9 @@ private:
             Room& neighbour = getNeighbour(room, i);
             if (!neighbour.visited) {
                 int size = calculateRegionSize(neighbour);
-#ifdef DOOR_PENALTY
-                if (size >= DOOR_PENALTY && room.size != 1 && neighbour.size == 1) {
-                    size -= DOOR_PENALTY;
+                if (Policy::doorPenalty && size >= params[DOOR_PENALTY] && room.size != 1 && neighbour.size == 1) {
+                    size -= params[DOOR_PENALTY];
                 }
-#endif
                 if (size > maxNeighbourSize) {
                     maxNeighbourSize = size;
                 }
@@ -413,19 +1534,27 @@ private:
         room.visited = false;
         // Multiply the room size, so we can apply 'half cell' bonuses/penalties
         int size = room.size * 2;
-#ifdef SHARED_ROOM_PENALTY
-        if (sharedNeighbour) {
-            size = size * SHARED_ROOM_PENALTY;
+        if (Policy::sharedRoomPenalty && sharedNeighbour) {
+            size = size * params[SHARED_ROOM_PENALTY] / 100;
+        }
+        if (Policy::unvisitedRoomBonus) {
+            size += (totalNeighbourSize - maxNeighbourSize) * params[UNVISITED_ROOM_BONUS] / 100;
         }
-#endif
-#ifdef UNVISITED_ROOM_BONUS
-        size += (totalNeighbourSize - maxNeighbourSize) * UNVISITED_ROOM_BONUS;
-#endif
         return size + maxNeighbourSize;
     }
 
 public:
+    EvalParams params;
+    BasicEvalCache<Board::players> cache;
+
     void calculate(const State& state, int turn = 0) {
+        flood(state, turn);
+        calculateRegionSizes(state);
+    }
+
+    // Flood fill from each player's head, dividing the board into regions and rooms
+    void flood(const State& state, int turn) {
+        STATS_TIMER(PHASE_FLOOD);
         clear();
         int nodeCount = 0;
 
@@ -437,74 +1566,80 @@ public:
             int playerNum = (i + turn) % state.numPlayers;
             if (state.isAlive(playerNum)) {
                 const Player& player = state.players[playerNum];
-                int px = player.x;
-                int py = player.y;
-                Vor& v = grid[px][py];
-                v.player = playerNum;
-                v.distance = 0;
-                v.room = playerNum;
-                addNode(px, py);
+                int head = Board::index(player.x, player.y);
+                owner[head] = playerNum;
+                distance[head] = 0;
+                roomOf[head] = playerNum;
+                addNode(head);
             }
             regions[playerNum] = playerNum;
+            reached[playerNum] = 0;
+            contact[playerNum] = INT_MAX;
         }
 
         for (int i = 0; i < nodeCount; i++) {
-            int x = openNodes[i].x;
-            int y = openNodes[i].y;
-            Vor& vor = grid[x][y];
-            if (vor.player == 254) {
+            int node = openNodes[i];
+            int vorPlayer = owner[node];
+            if (vorPlayer == 254) {
                 continue;
             }
+            // followed once per cell rather than once per neighbour; only combining rooms changes it
+            int vorRoom = trueId(roomOf[node]);
 
             for (int j = 0; j < 4; j++) {
-                int xOffset = xOffsets[j];
-                int yOffset = yOffsets[j];
-                int xx = x + xOffset;
-                int yy = y + yOffset;
-                if (!state.occupied(xx, yy)) {
-                    int vorRoom = trueId(vor.room);
-                    Vor& neighbour = grid[xx][yy];
-                    int neighbourPlayer = neighbour.player;
+                int offset = Board::neighbourOffsets[j];
+                int next = node + offset;
+                // the border is walls, so a board cell's neighbours never leave the grid
+                if (!state.occupied(next)) {
+                    int neighbourPlayer = owner[next];
                     if (neighbourPlayer == 255) {
-                        neighbour.player = vor.player;
-                        neighbour.distance = vor.distance + 1;
+                        owner[next] = vorPlayer;
+                        distance[next] = distance[node] + 1;
                         int neighbourRoom;
-                        if (state.isDoor(x, y, xOffset, yOffset)) {
+                        if (state.isDoor(node, offset)) {
                             neighbourRoom = addRoom();
                             makeNeighbours(vorRoom, neighbourRoom);
                         } else {
                             neighbourRoom = vorRoom;
                         }
-                        addNode(xx, yy);
-                        neighbour.room = neighbourRoom;
+                        addNode(next);
+                        roomOf[next] = neighbourRoom;
                         // neighbourRoom is definitely not dead
                         rooms[neighbourRoom].size++;
+                        reached[vorPlayer]++;
                     } else {
-                        int neighbourRoom = trueId(neighbour.room);
+                        int neighbourRoom = trueId(roomOf[next]);
                         if (vorRoom != neighbourRoom) {
-                            if (neighbourPlayer == vor.player) {
-                                if (state.isDoor(x, y, xOffset, yOffset)) {
+                            if (neighbourPlayer == vorPlayer) {
+                                if (state.isDoor(node, offset)) {
                                     makeNeighbours(vorRoom, neighbourRoom);
                                 } else {
                                     combineRooms(vorRoom, neighbourRoom);
+                                    vorRoom = min(vorRoom, neighbourRoom);
                                 }
                             } else {
-                                // Join the regions (buggy, because it might assign p0.region = 1, then later p1.region = 0)
-                                // regions[neighbourPlayer] = regions[vor.player];
-#ifdef NO_MANS_LAND
+                                contact[vorPlayer] = min(contact[vorPlayer], int(distance[node]));
                                 if (neighbourPlayer != 254) {
-                                    // Join the regions
-                                    regions[neighbourPlayer] = regions[vor.player];
-
-                                    if (neighbour.distance == vor.distance + 1) {
+                                    contact[neighbourPlayer] = min(contact[neighbourPlayer], int(distance[next]));
+                                    joinRegions(vorPlayer, neighbourPlayer);
+                                } else {
+                                    // the players who made it no man's land border it too
+                                    for (int k = 0; k < 4; k++) {
+                                        int other = owner[next + Board::neighbourOffsets[k]];
+                                        if (other < 254) {
+                                            joinRegions(vorPlayer, other);
+                                        }
+                                    }
+                                }
+                                if (Policy::noMansLand && neighbourPlayer != 254) {
+                                    if (distance[next] == distance[node] + 1) {
                                         // This is a shared boundary: remove it from the other player's territory
                                         // neighbourRoom is definitely not dead
                                         rooms[neighbourRoom].size--;
                                         // This cell is no man's land
-                                        neighbour.player = 254;
+                                        owner[next] = 254;
                                     }
                                 }
-#endif
                                 // Penalise both rooms
                                 // neighbourRoom and vorRoom are definitely not dead
                                 rooms[neighbourRoom].shared = true;
@@ -516,8 +1651,38 @@ public:
             }
         }
 
-        for (int i = 0; i < numPlayers; i++) {
-            if (state.isAlive(i)) {
+        openCount = nodeCount;
+        STATS_ADD(cellsExpanded, nodeCount);
+    }
+
+    // Whether the cells a player reached are a pocket: no other player can reach them, and there
+    // are few enough to look up. If so, collect them.
+    bool findPocket(const State& state, int player, Pocket& pocket) const {
+        if (!state.isAlive(player) || contact[player] != INT_MAX || reached[player] > POCKET_CELLS) {
+            return false;
+        }
+        int headX = state.players[player].x;
+        int headY = state.players[player].y;
+        pocket.size = 0;
+        for (int i = 0; i < openCount && pocket.size < reached[player]; i++) {
+            int node = openNodes[i];
+            if (owner[node] == player && distance[node] > 0) {
+                pocket.add(Board::column(node) - headX, Board::row(node) - headY);
+            }
+        }
+        return true;
+    }
+
+    // Size up each player's region from the room graph built by calculate
+    void calculateRegionSizes(const State& state) {
+        STATS_TIMER(PHASE_REGION_SIZES);
+        for (int i = 0; i < state.numPlayers; i++) {
+            Pocket pocket;
+            const PocketEntry* entry;
+            if (pocketTable.isOpen() && findPocket(state, i, pocket) && (entry = pocketTable.find(pocket.key()))) {
+                // exact, in the same half cells as the rooms
+                sizes[i] = entry->fill * 2;
+            } else if (state.isAlive(i)) {
                 Room& room = startingRoom(i);
                 sizes[i] = calculateRegionSize(room);
             } else {
@@ -530,14 +1695,24 @@ public:
         return sizes[player];
     }
 
-    inline const Vor& get(int x, int y) const {
-        return grid[x][y];
+    // Steps from a player's head to where their region meets another player's, from flood
+    inline int contactDistance(int player) const {
+        return contact[player];
+    }
+
+    inline Vor get(int x, int y) const {
+        int i = Board::index(x, y);
+        Vor vor;
+        vor.player = owner[i];
+        vor.distance = distance[i];
+        vor.room = roomOf[i];
+        return vor;
     }
 
     void print() const {
         cerr << hex;
-        for (int y = 0; y <= MAX_Y; y++) {
-            for (int x = 0; x <= MAX_X; x++) {
+        for (int y = 0; y < Board::height; y++) {
+            for (int x = 0; x < Board::width; x++) {
                 Vor vor = get(x, y);
                 cerr << setw(3) << (int(vor.player) >= 255 ? 255 : int(vor.player));
             }
@@ -546,8 +1721,24 @@ public:
         cerr << dec;
     }
 
+    // The lowest player whose region meets this player's, directly or through other players
     inline int regionForPlayer(int player) const {
-        return regions[player];
+        while (regions[player] != player) {
+            player = regions[player];
+        }
+        return player;
+    }
+
+    // The living players in the same region as a player, as a bitmask
+    typename Board::PlayerSet group(const State& state, int player) const {
+        typename Board::PlayerSet players = 0;
+        int region = regionForPlayer(player);
+        for (int i = 0; i < state.numPlayers; i++) {
+            if (state.isAlive(i) && regionForPlayer(i) == region) {
+                players |= typename Board::PlayerSet(1) << i;
+            }
+        }
+        return players;
     }
 
     inline Room& startingRoom(int player) {
@@ -560,32 +1751,59 @@ public:
     }
 };
 
-class Scores {
+typedef BasicVoronoi<StandardEval> Voronoi;
+
+template <int players>
+class BasicScores {
 public:
-    int scores[PLAYERS];
-    int ranks[PLAYERS];
-    int regions[PLAYERS];
+    int scores[players];
+    int ranks[players];
+    int regions[players];
     unsigned int losers;
     const char* move;
-#ifdef TRON_TRACE
-    char moves[30];
-#endif
+    // the search of these scores' line was cut off, as the player to move before it would not
+    // choose it
+    bool cut;
 
-    inline Scores() {
+    inline BasicScores() {
+        clearRegions();
         losers = 0;
         move = "";
+        cut = false;
     }
 
-    Scores(int score0, int score1) {
+    BasicScores(int score0, int score1) {
+        clearRegions();
         scores[0] = score0;
         scores[1] = score1;
         losers = 0;        
+        cut = false;
+    }
+
+    // Until an evaluation fills them in, each player has their own region, and checkBounds finds
+    // no one whose score is tied to another's
+    inline void clearRegions() {
+        for (int i = 0; i < players; i++) {
+            regions[i] = i;
+        }
     }
 
     inline void clearFlags() {
         losers = 0;
     }
 
+    // Each player's rank is the number of players with lower scores
+    inline void rank(int numPlayers) {
+        for (int i = 0; i < numPlayers; i++) {
+            ranks[i] = 0;
+            for (int j = 0; j < numPlayers; j++) {
+                if (i != j && scores[j] < scores[i]) {
+                    ranks[i]++;
+                }
+            }
+        }
+    }
+
     inline void setLoser(int player) {
         losers |= (1 << player);
     }
@@ -595,102 +1813,163 @@ public:
     }
 
     inline void print() const {
-        for (int i = 0; i < PLAYERS; i++) {
+        for (int i = 0; i < players; i++) {
             if (i != 0) {
                 cerr << " / ";
             }
             cerr << scores[i];
         }
         cerr << " / " << move;
-#ifdef TRON_TRACE
-        cerr << " / " << moves;
-#endif
         cerr << endl;
     }
 };
 
-class Bounds {
+template <int players>
+class BasicBounds {
 public:
-    int bounds[PLAYERS];
-#ifdef TRON_TRACE
-    char moves[PLAYERS][30];
-#endif
+    int bounds[players];
 
-    Bounds() {
-        for (int i = 0; i < PLAYERS; i++) {
+    BasicBounds() {
+        for (int i = 0; i < players; i++) {
             bounds[i] = INT_MIN;
         }
     }
 };
 
-void calculateScores(Scores& scores, Voronoi& voronoi, State& state, int turn) {
-    voronoi.calculate(state, turn);
+typedef BasicScores<PLAYERS> Scores;
+typedef BasicBounds<PLAYERS> Bounds;
 
-    // for (int i = 0; i < state.numPlayers; i++) {
-    //     scores.regions[i] = voronoi.regionForPlayer(i);
-    // }
+// The key of a leaf in the evaluation cache: the position as it stands, and the player who floods
+// first, who breaks ties. Mirror images are kept apart, as the flood expands each cell's
+// neighbours in a fixed order which a mirror reverses, so their scores need not be the same.
+template <class Board>
+inline uint64_t evaluationKey(const BasicState<Board>& state, int turn) {
+    return state.key(0) ^ mixBits(uint64_t(4) << 56 | turn % state.numPlayers);
+}
 
+// The scores of a position the Voronoi has just been calculated for
+template <class Policy, class Board>
+void scoreRegions(BasicScores<Board::players>& scores, BasicVoronoi<Policy, Board>& voronoi,
+        BasicState<Board>& state) {
     for (int i = 0; i < state.numPlayers; i++) {
+        scores.regions[i] = voronoi.regionForPlayer(i);
         scores.scores[i] = voronoi.playerRegionSize(i);
     }
 
     // penalise dead people. revive everyone and go through the deaths in order.
-    bool dead[PLAYERS] = {false, false, false, false};
+    bool dead[Board::players] = {false};
     int aliveCount = state.numPlayers;
+    int deathPenalty = voronoi.params[DEATH_PENALTY];
     for (int j = 0; j < state.deathCount; j++) {
         aliveCount--;
         int player = state.deadList[j];
-        scores.scores[player] -= 1000;
+        scores.scores[player] -= deathPenalty;
         dead[player] = true;
 
         // give the points to the players who were still alive at that point
         if (aliveCount > 0) {
             for (int i = 0; i < state.numPlayers; i++) {
                 if (!dead[i]) {
-                    scores.scores[i] += (1000 / aliveCount);
+                    scores.scores[i] += (deathPenalty / aliveCount);
                 }
             }
         }
     }
 
-    // calculate ranks
-    for (int i = 0; i < state.numPlayers; i++) {
-        scores.ranks[i] = 0;
-        for (int j = 0; j < state.numPlayers; j++) {
-            if (i != j && scores.scores[j] < scores.scores[i]) {
-                scores.ranks[i]++;
-            }
+    scores.rank(state.numPlayers);
+}
+
+template <class Policy, class Board>
+void calculateScores(BasicScores<Board::players>& scores, BasicVoronoi<Policy, Board>& voronoi, BasicState<Board>& state,
+        int turn) {
+    STATS_INC(leaves);
+    STATS_TIMER(PHASE_EVALUATE);
+    uint64_t key = 0;
+    if (voronoi.cache.isOpen()) {
+        key = evaluationKey(state, turn);
+        if (voronoi.cache.find(key, scores.scores, scores.regions, state.numPlayers)) {
+            STATS_INC(cacheHits);
+            scores.rank(state.numPlayers);
+            return;
+        }
+    }
+    voronoi.calculate(state, turn);
+    scoreRegions(scores, voronoi, state);
+    if (voronoi.cache.isOpen()) {
+        voronoi.cache.store(key, scores.scores, scores.regions, state.numPlayers);
+    }
+}
+
+// The scores of each of a player's moves, in the order given, where each leads to a leaf. Each
+// leaf is still flooded on its own, one after another; what the siblings share is their parent:
+// its doors are worked out once and patched around each move, rather than refreshed for the
+// whole board at every leaf, and every move's key is looked up in the cache before any is flooded.
+template <class Policy, class Board>
+void calculateSiblingScores(BasicScores<Board::players>* leafScores, const int* moves, int count,
+        BasicVoronoi<Policy, Board>& voronoi, BasicState<Board>& state, int player, int turn) {
+    STATS_TIMER(PHASE_EVALUATE);
+    int origX = state.players[player].x;
+    int origY = state.players[player].y;
+    uint64_t keys[4];
+    bool found[4] = {false};
+    if (voronoi.cache.isOpen()) {
+        for (int k = 0; k < count; k++) {
+            state.makeMove(player, origX + xOffsets[moves[k]], origY + yOffsets[moves[k]]);
+            keys[k] = evaluationKey(state, turn);
+            state.unmakeMove();
+        }
+        for (int k = 0; k < count; k++) {
+            found[k] = voronoi.cache.find(keys[k], leafScores[k].scores, leafScores[k].regions, state.numPlayers);
+        }
+    }
+
+    state.refreshDoorsNow();
+    for (int k = 0; k < count; k++) {
+        STATS_INC(leaves);
+        if (found[k]) {
+            STATS_INC(cacheHits);
+            leafScores[k].rank(state.numPlayers);
+            continue;
+        }
+        state.makeMovePatchingDoors(player, origX + xOffsets[moves[k]], origY + yOffsets[moves[k]]);
+        voronoi.calculate(state, turn);
+        scoreRegions(leafScores[k], voronoi, state);
+        state.unmakeMovePatchingDoors();
+        if (voronoi.cache.isOpen()) {
+            voronoi.cache.store(keys[k], leafScores[k].scores, leafScores[k].regions, state.numPlayers);
         }
     }
 }
 
 typedef void (*ScoreCalculator)(Scores& scores, Bounds& bounds, State& state, int turn, void* scoreCalculator, void* data);
 
-inline bool checkBounds(Bounds& bounds, Scores& scores, State& state, int player) {
+template <class Board>
+inline bool checkBounds(BasicBounds<Board::players>& bounds, BasicScores<Board::players>& scores,
+        BasicState<Board>& state, int player) {
     if (!state.pruningEnabled) {
         return false;
     }
-    int region = scores.regions[player];
-    for (int i = 0; i < state.numPlayers; i++) {
-        // Is bound exceeded?
-        if (i != player && scores.scores[i] + state.pruneMargin <= bounds.bounds[i]
-            // Is this player's score connected to mine (negative correlation)?
-            && scores.regions[i] == region
-            // Is this player's score connected to mine (positive correlation)?
-            && !(scores.isLoser(i) && scores.isLoser(player))) {
-#ifdef TRON_TRACEX
-            cerr << "Score " << scores.scores[i] << " breaks bound " << bounds.bounds[i] << " for player " << i
-                << " from " << bounds.moves[i] << endl;
-            scores.print();
-#endif
-            return true;
+    // Only the player who moved last is bounded: their bound is their best score among this
+    // node's siblings. Bounds from further up are not safe to cut on, as the players between
+    // may choose lines which those bounds never saw.
+    int parent = player;
+    for (int i = 1; i < state.numPlayers && parent == player; i++) {
+        int previous = (player + state.numPlayers - i) % state.numPlayers;
+        if (state.isMoving(previous)) {
+            parent = previous;
         }
     }
-    return false;
+    // Is bound exceeded?
+    return parent != player && scores.scores[parent] + state.pruneMargin <= bounds.bounds[parent]
+        // Is this player's score connected to mine (negative correlation)?
+        && scores.regions[parent] == scores.regions[player]
+        // Is this player's score connected to mine (positive correlation)?
+        && !(scores.isLoser(parent) && scores.isLoser(player));
 }
 
 // The given score will be chosen over the best score so far if it reduces *our* rank - this is an "avoid worst case" strategy
-inline bool worsensOurRank(Scores& scores, Scores& bestScores, int player, int thisPlayer) {
+template <int players>
+inline bool worsensOurRank(BasicScores<players>& scores, BasicScores<players>& bestScores, int player, int thisPlayer) {
     if (player == thisPlayer) {
         return false;
     }
@@ -698,130 +1977,611 @@ inline bool worsensOurRank(Scores& scores, Scores& bestScores, int player, int t
 }
 
 // The given score will be chosen over the best score so far if it improves the player's score (preserving rank)
-inline bool improvesTheirScore(Scores& scores, Scores& bestScores, int player) {
+template <int players>
+inline bool improvesTheirScore(BasicScores<players>& scores, BasicScores<players>& bestScores, int player) {
     return scores.ranks[player] == bestScores.ranks[player] && scores.scores[player] > bestScores.scores[player];
 }
 
 // The given score will be chosen over the best score so far if it improves the player's rank
-inline bool improvesTheirRank(Scores& scores, Scores& bestScores, int player) {
+template <int players>
+inline bool improvesTheirRank(BasicScores<players>& scores, BasicScores<players>& bestScores, int player) {
     return scores.ranks[player] > bestScores.ranks[player];
 }
 
-void minimax(Scores& scores, Bounds& parentBounds, State& state, int turn, void* sc, void* data) {
-    state.nodesSearched++;
-    Bounds bounds = parentBounds;
-    ScoreCalculator scoreCalculator = (ScoreCalculator) sc;
+// Selective search extends a line by a ply when a move leaves the mover in contact with another
+// player or passes through a door, up to SELECTIVE_PLIES along the line
+template <class Board>
+inline int extension(BasicState<Board>& state, int player, int fromX, int fromY, int move) {
+    if (!state.selectiveRange || state.depthAdjustment >= SELECTIVE_PLIES) {
+        return 0;
+    }
+    return state.inContact(player) || state.isDoor(fromX, fromY, xOffsets[move], yOffsets[move]);
+}
 
+// and reduces it by a ply when the player to move is out of reach of everyone else, by the
+// Voronoi of the position, as long as a few plies are left to search
+template <class Policy, class Board>
+inline int reduction(BasicVoronoi<Policy, Board>& voronoi, BasicState<Board>& state, int turn) {
+    if (!state.selectiveRange || state.depthAdjustment <= -SELECTIVE_PLIES || state.getMaxDepth() - turn < 3) {
+        return 0;
+    }
     int player = (state.thisPlayer + turn) % state.numPlayers;
+    if (!state.isMoving(player) || state.livingCount() == 1) {
+        return 0;
+    }
+    voronoi.flood(state, turn);
+    return voronoi.contactDistance(player) > state.selectiveRange;
+}
 
-    // Skip dead players, and fast forward to scoring when only one player left alive
-    if (!state.isAlive(player) || state.livingCount() == 1) {
-#ifdef TRON_TRACE
-        scores.moves[turn] = 'X';
-        scores.moves[turn + 1] = 0;
-#endif
+// With groups searched apart, a turn which passes is free, costing neither a ply nor a node,
+// while someone is left to move. Otherwise the plies run out one by one, and every turn is a
+// node, as they always were.
+template <class Board>
+inline int freePass(const BasicState<Board>& state) {
+    return state.decompositionEnabled && state.livingCount() > 1 && (state.alive & state.moving);
+}
+
+template <class Policy, class Board = StandardBoard>
+inline void policyRecursive(BasicScores<Board::players>& scores, BasicBounds<Board::players>& bounds,
+        BasicState<Board>& state, int turn, void* sc, void* data);
+
+// With nothing to cut off, and no move searched deeper than the rest, the moves at the last ply
+// all lead to leaves, and are scored from the parent by calculateSiblingScores when the leaves
+// are the Voronoi's
+template <class Policy, class Board>
+inline bool scoresSiblingLeaves(BasicState<Board>& state, int turn, void* sc) {
+    return turn + 1 >= state.getMaxDepth() && !state.pruningEnabled && !state.selectiveRange
+        && sc == (void*) policyRecursive<Policy, Board>;
+}
+
+template <class Policy = StandardEval, class Board = StandardBoard>
+void minimax(BasicScores<Board::players>& scores, BasicBounds<Board::players>& parentBounds, BasicState<Board>& state,
+        int turn, void* sc, void* data) {
+    typedef BasicScores<Board::players> Scores;
+    typedef BasicBounds<Board::players> Bounds;
+    typedef void (*BoardScoreCalculator)(Scores& scores, Bounds& bounds, BasicState<Board>& state, int turn,
+        void* scoreCalculator, void* data);
+    Bounds bounds = parentBounds;
+    BoardScoreCalculator scoreCalculator = (BoardScoreCalculator) sc;
+
+    int player = (state.thisPlayer + turn) % state.numPlayers;
+    TRACE(TRACE_ENTER, turn, player, 0, 0, 0);
+
+    // Skip dead players and those not searched, and fast forward to scoring when only one player left alive
+    if (!state.isMoving(player) || state.livingCount() == 1) {
+        TRACE(TRACE_SKIP, turn, player, 0, 0, 0);
+        int passed = freePass(state);
+        state.passes += passed;
+        state.nodesSearched += !passed;
         scoreCalculator(scores, bounds, state, turn + 1, (void*) scoreCalculator, data);
+        state.passes -= passed;
         return;
     }
+    state.nodesSearched++;
+    STATS_INC(nodes[min(turn, STATS_DEPTHS - 1)]);
 
     Scores bestScores;
     bestScores.scores[player] = INT_MIN;
     bestScores.ranks[player] = 0;
+    // this player's bound is set by the moves searched here, for the next player's cutoffs
+    bounds.bounds[player] = INT_MIN;
+    bool searched = false;
 
     int origX = state.players[player].x;
     int origY = state.players[player].y;
 
+    Scores leafScores[4];
+    bool leaves = scoresSiblingLeaves<Policy>(state, turn, sc);
+    if (leaves) {
+        int moves[4];
+        int count = 0;
+        for (int i = 0; i < 4; i++) {
+            if (!state.occupied(origX + xOffsets[i], origY + yOffsets[i])) {
+                moves[count++] = i;
+            }
+        }
+        calculateSiblingScores(leafScores, moves, count, *((BasicVoronoi<Policy, Board>*) data), state, player,
+            turn + 1);
+    }
+    int leaf = 0;
+
     for (int i = 0; i < 4; i++) {
         int x = origX + xOffsets[i];
         int y = origY + yOffsets[i];
         if (!state.occupied(x, y)) {
-#ifdef TRON_TRACE
-            scores.moves[turn] = dirs[i][0];
-            scores.moves[turn + 1] = 0;
-#endif
-            state.occupy(x, y, player);
-            scoreCalculator(scores, bounds, state, turn + 1, (void*) scoreCalculator, data);
-            state.unoccupy(x, y, player);
-            state.occupy(origX, origY, player); // restore player position
+            TRACE(TRACE_MOVE, turn, player, i, 0, 0);
+            if (leaves) {
+                scores = leafScores[leaf++];
+                TRACE(TRACE_LEAF, turn + 1, 0, 0, scores.scores, state.numPlayers);
+            } else {
+                state.makeMove(player, x, y);
+                int plies = extension(state, player, origX, origY, i);
+                state.depthAdjustment += plies;
+                scores.cut = false;
+                scoreCalculator(scores, bounds, state, turn + 1, (void*) scoreCalculator, data);
+                state.depthAdjustment -= plies;
+                state.unmakeMove();
+            }
+            searched = true;
+            if (scores.cut) {
+                // a move no better for us than one already found
+                scores.cut = false;
+                continue;
+            }
             scores.move = dirs[i];
             if (checkBounds(bounds, scores, state, player)) {
-#ifdef TRON_TRACEX
-                cerr << "Pruned at " << scores.moves << endl;
-                cerr << "          ";
-                for (int j = 0; j < turn; j++) {
-                    cerr << " ";
-                }
-                cerr << "^" << endl;
-#endif
+                STATS_INC(cutoffs);
+                TRACE(TRACE_PRUNE, turn, player, i, scores.scores, state.numPlayers);
+                scores.cut = true;
                 return;
             }
-#ifdef TRON_TRACE
-            for (int k = 0; k < turn; k++) cerr << "  ";
-            cerr << "player " << player << ": ";
-            scores.print();
-#endif
+            TRACE(TRACE_SCORE, turn, player, i, scores.scores, state.numPlayers);
             if (improvesTheirRank(scores, bestScores, player)
-#ifdef WORST_CASE_TESTING
-                    || worsensOurRank(scores, bestScores, player, state.thisPlayer)
-#endif
+                    || (Policy::worstCase && worsensOurRank(scores, bestScores, player, state.thisPlayer))
                     || improvesTheirScore(scores, bestScores, player)) {
                 bestScores = scores;
                 if (state.pruningEnabled) {
                     bounds.bounds[player] = scores.scores[player];
-#ifdef TRON_TRACE
-                    strcpy(bounds.moves[player], scores.moves);
-#endif
                 }
             }
         }
     }
 
-    if (bestScores.scores[player] == INT_MIN) {
+    if (!searched) {
         // All moves are illegal - player dies and turn passes to the next player
-#ifdef TRON_TRACE
-        scores.moves[turn] = 'G';
-        scores.moves[turn + 1] = 0;
-#endif
-        state.kill(player);
+        TRACE(TRACE_DIE, turn, player, 4, 0, 0);
+        state.makeDeath(player);
         scoreCalculator(scores, bounds, state, turn + 1, (void*) scoreCalculator, data);
-        state.revive(player);
+        state.unmakeMove();
         scores.move = GULP;
     } else {
         scores = bestScores;
-#ifdef TRON_TRACE
-        for (int k = 0; k < turn; k++) cerr << "  ";
-        cerr << "player " << player << " chose ";
-        scores.print();
-#endif
+        TRACE(TRACE_CHOOSE, turn, player, moveIndex(scores.move), scores.scores, state.numPlayers);
+    }
+}
+
+// Players whose regions do not meet cannot affect each other, so the tree of the whole position is
+// the product of a tree for each group of players whose regions do. Only our group's tree can
+// change our move, so only our group is searched: the others pass, at no cost in plies, and keep
+// the scores their regions give them at the leaves. Our group therefore searches as deep as if it
+// were alone on the board.
+//
+// The other groups are frozen alive, so no one in them dies within the search. The scores differ
+// from the joint search's where one of them would run out of space within its horizon: the
+// living then miss their share of that player's death penalty, and that player keeps the share
+// of our group's deaths which they would have lost by dying first.
+// Returns false, having searched nothing, if the living players are all in one group.
+template <class Policy, class Board>
+bool searchGroups(BasicScores<Board::players>& scores, BasicState<Board>& state, void* sc,
+        BasicVoronoi<Policy, Board>& voronoi) {
+    typedef typename Board::PlayerSet PlayerSet;
+    if (!state.isAlive(state.thisPlayer)) {
+        return false;
+    }
+    voronoi.flood(state, 0);
+    PlayerSet ours = voronoi.group(state, state.thisPlayer);
+    bool separated = false;
+    for (int i = 0; i < state.numPlayers; i++) {
+        separated = separated || (state.isAlive(i) && !(ours & (PlayerSet(1) << i)));
+    }
+    if (!separated) {
+        return false;
+    }
+
+    BasicBounds<Board::players> bounds;
+    state.moving = ours;
+    minimax<Policy>(scores, bounds, state, 0, sc, &voronoi);
+    state.moving = PlayerSet(~0);
+    return true;
+}
+
+template <class Policy, class Board>
+inline void policyRecursive(BasicScores<Board::players>& scores, BasicBounds<Board::players>& bounds,
+        BasicState<Board>& state, int turn, void* sc, void* data) {
+    BasicVoronoi<Policy, Board>& voronoi = *((BasicVoronoi<Policy, Board>*)data);
+    if (turn >= state.getMaxDepth()) {
+        calculateScores(scores, voronoi, state, turn);
+        TRACE(TRACE_LEAF, turn, 0, 0, scores.scores, state.numPlayers);
+    } else if (turn > 0 || !state.decompositionEnabled || !searchGroups(scores, state, sc, voronoi)) {
+        int plies = reduction(voronoi, state, turn);
+        state.depthAdjustment -= plies;
+        minimax<Policy>(scores, bounds, state, turn, sc, data);
+        state.depthAdjustment += plies;
     }
 }
 
-void voronoiRecursive(Scores& scores, Bounds& bounds, State& state, int turn, void* sc, void* data) {
+// Paranoid search: every opponent is assumed to play against us, so each node only compares our
+// score and alpha-beta cutoffs apply at every ply. Minimax compares every player's rank and score;
+// here the cost of a node does not grow with the number of players, so this is the search for
+// games with many players. Returns our score, and the scores at the end of the chosen line.
+template <class Policy, class Board>
+int paranoid(BasicScores<Board::players>& scores, int alpha, int beta, BasicState<Board>& state, int turn,
+        BasicVoronoi<Policy, Board>& voronoi) {
     if (turn >= state.getMaxDepth()) {
-        calculateScores(scores, *((Voronoi*)data), state, turn);
+        calculateScores(scores, voronoi, state, turn);
+        TRACE(TRACE_LEAF, turn, 0, 0, scores.scores, state.numPlayers);
+        return scores.scores[state.thisPlayer];
+    }
+
+    int player = (state.thisPlayer + turn) % state.numPlayers;
+    TRACE(TRACE_ENTER, turn, player, 0, 0, 0);
+    if (!state.isMoving(player) || state.livingCount() == 1) {
+        TRACE(TRACE_SKIP, turn, player, 0, 0, 0);
+        int passed = freePass(state);
+        state.passes += passed;
+        state.nodesSearched += !passed;
+        int value = paranoid(scores, alpha, beta, state, turn + 1, voronoi);
+        state.passes -= passed;
+        return value;
+    }
+    state.nodesSearched++;
+    STATS_INC(nodes[min(turn, STATS_DEPTHS - 1)]);
+    int reduced = reduction(voronoi, state, turn);
+    state.depthAdjustment -= reduced;
+
+    bool ours = player == state.thisPlayer;
+    int best = ours ? INT_MIN : INT_MAX;
+    BasicScores<Board::players> lineScores;
+    int origX = state.players[player].x;
+    int origY = state.players[player].y;
+    for (int i = 0; i < 4; i++) {
+        int x = origX + xOffsets[i];
+        int y = origY + yOffsets[i];
+        if (!state.occupied(x, y)) {
+            TRACE(TRACE_MOVE, turn, player, i, 0, 0);
+            state.makeMove(player, x, y);
+            int plies = extension(state, player, origX, origY, i);
+            state.depthAdjustment += plies;
+            int value = paranoid(lineScores, alpha, beta, state, turn + 1, voronoi);
+            state.depthAdjustment -= plies;
+            state.unmakeMove();
+            TRACE(TRACE_SCORE, turn, player, i, lineScores.scores, state.numPlayers);
+            if (ours ? value > best : value < best) {
+                best = value;
+                scores = lineScores;
+                scores.move = dirs[i];
+            }
+            if (ours) {
+                alpha = max(alpha, value);
+            } else {
+                beta = min(beta, value);
+            }
+            if (alpha >= beta) {
+                STATS_INC(cutoffs);
+                TRACE(TRACE_PRUNE, turn, player, i, lineScores.scores, state.numPlayers);
+                state.depthAdjustment += reduced;
+                return best;
+            }
+        }
+    }
+
+    if (best == (ours ? INT_MIN : INT_MAX)) {
+        // All moves are illegal - player dies and turn passes to the next player
+        TRACE(TRACE_DIE, turn, player, 4, 0, 0);
+        state.makeDeath(player);
+        best = paranoid(scores, alpha, beta, state, turn + 1, voronoi);
+        state.unmakeMove();
+        scores.move = GULP;
     } else {
-        minimax(scores, bounds, state, turn, sc, data);
+        TRACE(TRACE_CHOOSE, turn, player, moveIndex(scores.move), scores.scores, state.numPlayers);
+    }
+    state.depthAdjustment += reduced;
+    return best;
+}
+
+template <class Policy, class Board = StandardBoard>
+void paranoidRecursive(BasicScores<Board::players>& scores, BasicBounds<Board::players>&, BasicState<Board>& state,
+        int turn, void*, void* data) {
+    BasicVoronoi<Policy, Board>& voronoi = *((BasicVoronoi<Policy, Board>*) data);
+    if (turn == 0 && state.decompositionEnabled && state.isAlive(state.thisPlayer)) {
+        // only the players whose regions meet ours can change our score
+        voronoi.flood(state, 0);
+        state.moving = voronoi.group(state, state.thisPlayer);
+    }
+    paranoid(scores, INT_MIN, INT_MAX, state, turn, voronoi);
+    state.moving = typename Board::PlayerSet(~0);
+}
+
+// The standard search, as a score calculator. It is policyRecursive itself, so that minimax knows
+// its leaves are the Voronoi's.
+const ScoreCalculator voronoiRecursive = policyRecursive<StandardEval, StandardBoard>;
+
+// An evaluator compiled with one policy, so that variants can be chosen by name at startup. The
+// evaluator is opaque: it is made by create, and passed as the data of search.
+class EvalVariant {
+public:
+    const char* name;
+    const char* description;
+    unsigned params;    // bitmask of the EvalParams used
+    void* (*create)(const EvalParams& params);
+    void (*destroy)(void* evaluator);
+    void (*evaluate)(Scores& scores, void* evaluator, State& state, int turn);
+    ScoreCalculator search;
+};
+
+template <class Policy>
+void* createEvaluator(const EvalParams& params) {
+    BasicVoronoi<Policy>* voronoi = new BasicVoronoi<Policy>();
+    voronoi->params = params;
+    voronoi->cache.resize(evalCacheBits);
+    return voronoi;
+}
+
+template <class Policy>
+void destroyEvaluator(void* evaluator) {
+    delete (BasicVoronoi<Policy>*) evaluator;
+}
+
+template <class Policy>
+void evaluate(Scores& scores, void* evaluator, State& state, int turn) {
+    calculateScores(scores, *((BasicVoronoi<Policy>*) evaluator), state, turn);
+}
+
+#define EVAL_VARIANT(name, policy, description) \
+    {name, description, policy::params, createEvaluator<policy>, destroyEvaluator<policy>, evaluate<policy>, \
+        policyRecursive<policy, StandardBoard>}
+
+const EvalVariant evalVariants[] = {
+    EVAL_VARIANT("standard", StandardEval, "no man's land and shared room penalty"),
+    EVAL_VARIANT("plain", PlainEval, "region sizes only"),
+    EVAL_VARIANT("bonus", BonusEval, "standard with unvisited room bonus"),
+    EVAL_VARIANT("doors", DoorsEval, "standard with door penalty"),
+    EVAL_VARIANT("full", FullEval, "every evaluation term"),
+    EVAL_VARIANT("worst-case", WorstCaseEval, "standard, assuming opponents target us"),
+    {"paranoid", "standard, with a paranoid alpha-beta search", StandardEval::params, createEvaluator<StandardEval>,
+        destroyEvaluator<StandardEval>, evaluate<StandardEval>, paranoidRecursive<StandardEval, StandardBoard>}
+};
+
+#define EVAL_VARIANTS int(sizeof(evalVariants) / sizeof(evalVariants[0]))
+
+inline const EvalVariant* findEvalVariant(const string& name) {
+    for (int i = 0; i < EVAL_VARIANTS; i++) {
+        if (name == evalVariants[i].name) {
+            return &evalVariants[i];
+        }
+    }
+    return 0;
+}
+
+#define LOG_MAGIC "TRNL"
+#define LOG_VERSION 1
+
+// Game records are a LogHeader followed by one TurnRecord per turn. Each bot process writes a
+// new header when it starts, so a file may hold several games back to back. Both blocks are 64
+// bytes so that a record file can be mapped and indexed directly.
+struct LogHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t width;
+    uint8_t height;
+    uint8_t players;
+    uint8_t recordSize;
+    uint8_t pad[54];
+};
+
+struct TurnRecord {
+    int16_t coords[PLAYERS][4];
+    int32_t scores[PLAYERS];
+    int32_t nodes;
+    int32_t elapsed;        // microseconds
+    int8_t numPlayers;
+    int8_t thisPlayer;
+    int8_t move;            // index into dirs, or 4 for GULP
+    int8_t maxDepth;        // the depth limit searched to, short of which a timeout may stop
+    uint8_t timeout;
+    uint8_t pad[3];
+
+    void set(const TurnInput& input, const Scores& result, const State& state, long micros, bool timedOut) {
+        memset(this, 0, sizeof(TurnRecord));
+        numPlayers = input.numPlayers;
+        thisPlayer = input.thisPlayer;
+        for (int i = 0; i < input.numPlayers; i++) {
+            for (int j = 0; j < 4; j++) {
+                coords[i][j] = input.coords[i][j];
+            }
+            scores[i] = result.scores[i];
+        }
+        move = moveIndex(result.move);
+        maxDepth = state.maxDepth;
+        nodes = state.nodesSearched;
+        elapsed = micros;
+        timeout = timedOut;
+    }
+
+    void get(TurnInput& input) const {
+        input.numPlayers = numPlayers;
+        input.thisPlayer = thisPlayer;
+        for (int i = 0; i < numPlayers; i++) {
+            for (int j = 0; j < 4; j++) {
+                input.coords[i][j] = coords[i][j];
+            }
+        }
+    }
+};
+
+inline bool isLogHeader(const void* block) {
+    return memcmp(block, LOG_MAGIC, 4) == 0;
+}
+
+class GameLog {
+private:
+    FILE* file;
+
+public:
+    GameLog() {
+        file = 0;
+    }
+
+    ~GameLog() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool open(const char* path) {
+        file = fopen(path, "ab");
+        if (!file) {
+            return false;
+        }
+        LogHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, LOG_MAGIC, 4);
+        header.version = LOG_VERSION;
+        header.width = WIDTH;
+        header.height = HEIGHT;
+        header.players = PLAYERS;
+        header.recordSize = sizeof(TurnRecord);
+        fwrite(&header, sizeof(header), 1, file);
+        fflush(file);
+        return true;
+    }
+
+    inline bool isOpen() const {
+        return file != 0;
+    }
+
+    // One buffered write per turn, made after the move has been sent
+    inline void append(const TurnRecord& record) {
+        fwrite(&record, sizeof(record), 1, file);
+        fflush(file);
     }
+};
+
+// The symmetries on the standard board
+inline int symmetricX(int x, int symmetry) {
+    return symmetry & 1 ? MAX_X - x : x;
+}
+
+inline int symmetricY(int y, int symmetry) {
+    return symmetry & 2 ? MAX_Y - y : y;
 }
 
-void run() {
+// RIGHT and LEFT swap in a mirror across the board, DOWN and UP in one down it
+inline int symmetricMove(int move, int symmetry) {
+    if ((move < 2 && (symmetry & 1)) || ((move == 2 || move == 3) && (symmetry & 2))) {
+        return move ^ 1;
+    }
+    return move;
+}
+
+struct BookEntry {
+    static const char magic[5];
+    // 2: keys from State::key, which hashes each player's trail
+    static const int version = 2;
+
+    uint64_t key;
+    int32_t score;          // the mover's score from the book's search
+    uint8_t move;           // index into dirs, as seen through the canonical symmetry
+    uint8_t depth;
+    uint8_t pad[2];
+
+    inline bool operator<(const BookEntry& other) const {
+        return key < other.key;
+    }
+};
+
+const char BookEntry::magic[5] = "TRNB";
+
+// An opening book: the moves for positions of the first turns, searched deeply offline by
+// tron_book, keyed by their canonical image
+class Book : public MappedTable<BookEntry> {
+public:
+    // The book's move for a position, or null if it is not in the book. A move into an occupied
+    // cell can only come from a hash collision, and is ignored.
+    const char* lookup(const State& state) const {
+        int symmetry;
+        const BookEntry* entry = find(state.canonicalKey(symmetry));
+        if (!entry || entry->move > 3) {
+            return 0;
+        }
+        int move = symmetricMove(entry->move, symmetry);
+        if (state.occupied(state.x() + xOffsets[move], state.y() + yOffsets[move])) {
+            return 0;
+        }
+        return dirs[move];
+    }
+};
+
+void run(const char* logPath, const char* statsPath, const char* tracePath, int traceEvery, const char* bookPath,
+        int nodeLimit, const EvalParams& params, const EvalVariant& variant) {
     State state;
+    if (nodeLimit) {
+        state.setNodeBudget(nodeLimit);
+    }
+    // the eval cache wants a key at every leaf
+    state.setHashing(evalCacheBits > 0);
     Scores scores;
-    Voronoi voronoi;
+    void* evaluator = variant.create(params);
     Bounds bounds;
+    GameLog log;
+    TurnInput input;
+    TurnRecord record;
+
+    if (logPath && !log.open(logPath)) {
+        cerr << "Cannot open game log " << logPath << endl;
+    }
+#ifdef TRON_STATS
+    ofstream statsFile;
+    if (statsPath) {
+        statsFile.open(statsPath, ios::app);
+    }
+    ostream& statsOut = statsPath ? statsFile : cerr;
+#else
+    if (statsPath) {
+        cerr << "Search statistics need a build with TRON_STATS; not writing " << statsPath << endl;
+    }
+#endif
+    Tracer* turnTracer = 0;
+    FILE* traceFile = 0;
+    if (tracePath) {
+        traceFile = fopen(tracePath, "ab");
+        if (traceFile) {
+            turnTracer = new Tracer();
+        } else {
+            cerr << "Cannot open trace file " << tracePath << endl;
+        }
+    }
+    Book book;
+    if (bookPath && !book.open(bookPath)) {
+        cerr << "Cannot open opening book " << bookPath << endl;
+    }
+    int turn = 0;
 
     while (1) {
-        state.readTurn(cin);
+        input.read(cin);
+        if (!cin) {
+            break;
+        }
+        state.applyTurn(input);
 
         // for (int i = 0; i < state.numPlayers; i++) {
         //     cerr << state.players[i].x << "," << state.players[i].y << endl;
         // }
 
-        long start = millis();
-        minimax(scores, bounds, state, 0, (void*) voronoiRecursive, &voronoi);
-        long elapsed = millis() - start;
-        cerr << elapsed << "ms";
-        if (state.isTimeLimitReached()) {
+        STATS_RESET();
+        tracer = turnTracer && turn % traceEvery == 0 ? turnTracer : 0;
+        if (tracer) {
+            tracer->clear();
+        }
+        long start = micros();
+        const char* bookMove = book.isOpen() ? book.lookup(state) : 0;
+        if (bookMove) {
+            // the book holds no scores for the position, so none are reported
+            scores = Scores();
+            memset(scores.scores, 0, sizeof(scores.scores));
+            memset(scores.ranks, 0, sizeof(scores.ranks));
+            scores.move = bookMove;
+        } else {
+            STATS_TIMER(PHASE_SEARCH);
+            variant.search(scores, bounds, state, 0, (void*) variant.search, evaluator);
+        }
+        long elapsed = micros() - start;
+        bool timedOut = state.isTimeLimitReached();
+        cerr << elapsed / 1000 << "ms";
+        if (bookMove) {
+            cerr << " (book)";
+        }
+        if (timedOut) {
             cerr << " (timeout)";
         }
         cerr << endl;
@@ -837,12 +2597,96 @@ void run() {
         cerr << state.nodesSearched << " nodes" << endl;
 
         cout << scores.move << endl;
+        STATS_REPORT(statsOut, turn);
+        if (tracer) {
+            tracer->write(traceFile, turn, state.numPlayers, state.thisPlayer, state.maxDepth);
+            tracer = 0;
+        }
+        turn++;
+
+        if (log.isOpen()) {
+            record.set(input, scores, state, elapsed, timedOut);
+            log.append(record);
+        }
+    }
+    variant.destroy(evaluator);
+    if (traceFile) {
+        fclose(traceFile);
     }
+    delete turnTracer;
 }
 
-#if !defined(TRON_TESTS) && !defined(TRON_PROF)
-int main() {
-    run();
+#if !defined(TRON_TESTS) && !defined(TRON_PROF) && !defined(TRON_TOOL)
+int main(int argc, char* argv[]) {
+    const char* logPath = 0;
+    const char* statsPath = 0;
+    const char* tracePath = 0;
+    int traceEvery = 1;
+    const char* bookPath = 0;
+    int nodeLimit = 0;
+    EvalParams params;
+    const EvalVariant* variant = &evalVariants[0];
+    int opt;
+    while ((opt = getopt(argc, argv, "l:p:e:s:t:T:b:f:c:n:")) != -1) {
+        switch (opt) {
+        case 'l':
+            logPath = optarg;
+            break;
+        case 'p': {
+            ifstream is(optarg);
+            if (!is || !params.read(is)) {
+                cerr << "Cannot read evaluation parameters from " << optarg << endl;
+                return 1;
+            }
+            break;
+        }
+        case 's':
+            statsPath = optarg;
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        case 'T':
+            traceEvery = max(1, atoi(optarg));
+            break;
+        case 'b':
+            bookPath = optarg;
+            break;
+        case 'f':
+            if (!pocketTable.open(optarg)) {
+                cerr << "Cannot open pocket table " << optarg << endl;
+            }
+            break;
+        case 'c':
+            evalCacheBits = min(30, max(0, atoi(optarg)));
+            break;
+        case 'n':
+            nodeLimit = max(0, atoi(optarg));
+            break;
+        case 'e':
+            variant = findEvalVariant(optarg);
+            if (!variant) {
+                cerr << "Unknown evaluator " << optarg << "; choose from";
+                for (int i = 0; i < EVAL_VARIANTS; i++) {
+                    cerr << " " << evalVariants[i].name;
+                }
+                cerr << endl;
+                return 1;
+            }
+            break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-l gamelog] [-p params] [-e evaluator] [-s statsfile] [-t tracefile]"
+                << " [-T every] [-b book] [-f pockets] [-c cache_bits] [-n nodes]" << endl;
+            cerr << "  -s  append per-turn search statistics here instead of stderr (built with TRON_STATS)" << endl;
+            cerr << "  -t  append a search trace of every Tth turn here, for tron_trace" << endl;
+            cerr << "  -b  play positions found in this opening book, from tron_book, without searching" << endl;
+            cerr << "  -f  score small enclosed pockets by their exact fill, from tron_pockets" << endl;
+            cerr << "  -c  cache 2^cache_bits evaluations" << endl;
+            cerr << "  -n  search this many nodes per move instead of for a time, for moves which do not vary" << endl;
+            return 1;
+        }
+    }
+    run(logPath, statsPath, tracePath, traceEvery, bookPath, nodeLimit, params, *variant);
     return 0;
 }
 #endif
@@ -0,0 +1,253 @@
+#include "tron.cc"
+#include "tron_util.cc"
+#include "tron_game.cc"
+
+// Batch analysis. Searches every position in a corpus file (see positions.txt), or every turn of a
+// game given as the referee's turn input, across worker threads, and writes one JSON or CSV line
+// per position with the move, the scores, the depth, the nodes and the time. Positions search to
+// their own depth unless one is given; with a time limit, each search stops after that much
+// thread CPU time.
+
+class Analysis {
+public:
+    const char* move;
+    int scores[PLAYERS];
+    int depth;
+    long nodes;
+    long time;        // microseconds of thread CPU time
+    bool timedOut;
+};
+
+class Analyzer {
+private:
+    pthread_mutex_t lock;
+    unsigned next;
+
+    long claim() {
+        pthread_mutex_lock(&lock);
+        long index = next < positions.size() ? long(next++) : -1;
+        pthread_mutex_unlock(&lock);
+        return index;
+    }
+
+    void analyze(const Position& position, void* evaluator, Analysis& analysis) const {
+        State state = position.state;
+        int depth = engine.maxDepth > 0 ? engine.maxDepth : state.maxDepth;
+        engine.configure(state);
+        state.maxDepth = depth;
+        state.resetTimer();
+        state.nodesSearched = 0;
+
+        Scores scores;
+        Bounds bounds;
+        const EvalVariant* variant = engine.variant;
+        long start = threadMicros();
+        variant->search(scores, bounds, state, 0, (void*) variant->search, evaluator);
+        analysis.time = threadMicros() - start;
+        analysis.move = scores.move;
+        for (int i = 0; i < state.numPlayers; i++) {
+            analysis.scores[i] = scores.scores[i];
+        }
+        analysis.depth = depth;
+        analysis.nodes = state.nodesSearched;
+        analysis.timedOut = state.isTimeLimitReached();
+    }
+
+    static void* worker(void* data) {
+        Analyzer& analyzer = *(Analyzer*) data;
+        void* evaluator = analyzer.engine.variant->create(analyzer.engine.params);
+        long index;
+        while ((index = analyzer.claim()) >= 0) {
+            analyzer.analyze(analyzer.positions[index], evaluator, analyzer.results[index]);
+        }
+        analyzer.engine.variant->destroy(evaluator);
+        return 0;
+    }
+
+public:
+    Engine engine;
+    vector<Position> positions;
+    vector<Analysis> results;
+
+    Analyzer() : next(0) {
+        pthread_mutex_init(&lock, 0);
+        engine.name = "analyze";
+        engine.maxDepth = 0;
+        engine.timeLimit = 0;
+    }
+
+    void run(int threads) {
+        results.resize(positions.size());
+        vector<pthread_t> workers(threads);
+        for (int i = 0; i < threads; i++) {
+            pthread_create(&workers[i], 0, worker, this);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i], 0);
+        }
+    }
+};
+
+// Each turn of a game, as the referee's turn input, becomes a position
+bool loadGame(istream& is, vector<Position>& positions) {
+    State state;
+    state.timeLimitEnabled = false;
+    TurnInput input;
+    int turn = 0;
+    while (true) {
+        input.read(is);
+        if (!is) {
+            break;
+        }
+        state.applyTurn(input);
+        ostringstream name;
+        name << "turn" << turn++;
+        positions.push_back(Position());
+        positions.back().name = name.str();
+        positions.back().state = state;
+    }
+    return is.eof();
+}
+
+// Quote a name for JSON or CSV output
+string quoted(const string& s) {
+    string q = "\"";
+    for (unsigned i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            q += '\\';
+        }
+        q += s[i];
+    }
+    return q + "\"";
+}
+
+void writeJson(ostream& os, const Position& position, const Analysis& a) {
+    os << "{\"name\": " << quoted(position.name) << ", \"player\": " << position.state.thisPlayer
+        << ", \"move\": \"" << a.move << "\", \"scores\": [";
+    for (int i = 0; i < position.state.numPlayers; i++) {
+        os << (i ? ", " : "") << a.scores[i];
+    }
+    os << "], \"depth\": " << a.depth << ", \"nodes\": " << a.nodes << ", \"time_us\": " << a.time
+        << ", \"timed_out\": " << (a.timedOut ? "true" : "false") << "}" << endl;
+}
+
+void writeCsvHeader(ostream& os) {
+    os << "name,player,move,depth,nodes,time_us,timed_out";
+    for (int i = 0; i < PLAYERS; i++) {
+        os << ",score" << i;
+    }
+    os << endl;
+}
+
+void writeCsv(ostream& os, const Position& position, const Analysis& a) {
+    os << quoted(position.name) << "," << position.state.thisPlayer << "," << a.move << "," << a.depth << ","
+        << a.nodes << "," << a.time << "," << a.timedOut;
+    for (int i = 0; i < PLAYERS; i++) {
+        os << ",";
+        if (i < position.state.numPlayers) {
+            os << a.scores[i];
+        }
+    }
+    os << endl;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-g] [-f json|csv] [-j threads] [-d depth] [-t ms] [-e name:key=value,...]"
+        << " [-o output] [file]" << endl;
+    cerr << "  -g  the file is a game's turn input, as sent by the referee, rather than a corpus" << endl;
+    cerr << "  -d  search depth (default: each position's own)" << endl;
+    cerr << "  -t  ms of CPU time per position (default: none)" << endl;
+    cerr << "  engine settings are as for tron_arena" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    Analyzer analyzer;
+    bool game = false;
+    bool csv = false;
+    int threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    const char* outputPath = 0;
+    int depth = 0;
+    int timeLimit = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "gf:j:d:t:e:o:")) != -1) {
+        switch (opt) {
+        case 'g':
+            game = true;
+            break;
+        case 'f':
+            csv = string(optarg) == "csv";
+            if (!csv && string(optarg) != "json") {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            threads = max(1, atoi(optarg));
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 't':
+            timeLimit = atoi(optarg);
+            break;
+        case 'e':
+            if (!analyzer.engine.parse(optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    // -d and -t override the engine's settings, whichever order they came in
+    if (depth) {
+        analyzer.engine.maxDepth = depth;
+    }
+    if (timeLimit) {
+        analyzer.engine.timeLimit = timeLimit;
+    }
+
+    const char* path = optind < argc ? argv[optind] : CORPUS_PATH;
+    ifstream is(path);
+    if (!is) {
+        cerr << "Cannot open " << path << endl;
+        return 1;
+    }
+    if (!(game ? loadGame(is, analyzer.positions) : loadCorpus(is, analyzer.positions))) {
+        cerr << "Cannot read " << (game ? "turns" : "positions") << " from " << path << endl;
+        return 1;
+    }
+
+    threads = max(1, min(threads, (int) analyzer.positions.size()));
+    long start = micros();
+    analyzer.run(threads);
+    long elapsed = micros() - start;
+
+    ofstream file;
+    if (outputPath) {
+        file.open(outputPath);
+    }
+    ostream& os = outputPath ? file : cout;
+    if (csv) {
+        writeCsvHeader(os);
+    }
+    long nodes = 0;
+    for (unsigned i = 0; i < analyzer.positions.size(); i++) {
+        const Analysis& a = analyzer.results[i];
+        nodes += a.nodes;
+        if (csv) {
+            writeCsv(os, analyzer.positions[i], a);
+        } else {
+            writeJson(os, analyzer.positions[i], a);
+        }
+    }
+    cerr << analyzer.positions.size() << " positions in " << fixed << setprecision(3) << elapsed / 1e6 << "s on "
+        << threads << " threads: " << setprecision(1) << analyzer.positions.size() / max(1e-6, elapsed / 1e6)
+        << " positions/s, " << nodes / max(1e-6, elapsed / 1e6) << " nodes/s" << endl;
+    return 0;
+}
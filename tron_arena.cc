@@ -0,0 +1,183 @@
+#include "tron.cc"
+#include "tron_game.cc"
+
+// Self-play arena. Engine variants play each other in parallel worker threads from random start
+// positions (see Match), and the results are reported as win rates and Elo differences. The first
+// two engines are also compared with a sequential probability ratio test, which stops the match
+// once it can tell whether the first is at least elo1 stronger or at most elo0.
+
+class Options {
+public:
+    vector<Engine> engines;
+    vector<int> playerCounts;
+    long games;
+    int threads;
+    unsigned seed;
+    long hardLimit;
+    bool sprt;
+    double elo0;
+    double elo1;
+    double alpha;
+    double beta;
+    long reportEvery;
+
+    Options() {
+        games = 1000;
+        threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+        seed = 1;
+        hardLimit = 0;
+        sprt = true;
+        elo0 = 0;
+        elo1 = 10;
+        alpha = beta = 0.05;
+        reportEvery = 100;
+    }
+};
+
+class Arena : public Match {
+public:
+    const Options& options;
+    string verdict;
+
+    Arena(const Options& p_options)
+            : Match(p_options.engines, p_options.playerCounts, p_options.games, p_options.seed), options(p_options) {
+        hardLimit = options.hardLimit;
+    }
+
+protected:
+    void recorded() {
+        if (options.sprt && !isStopped()) {
+            double llr = sprtLLR(tallies[0][1], options.elo0, options.elo1);
+            if (llr >= log((1 - options.beta) / options.alpha)) {
+                stop();
+                verdict = "H1 accepted";
+            } else if (llr <= log(options.beta / (1 - options.alpha))) {
+                stop();
+                verdict = "H0 accepted";
+            }
+        }
+        if (options.reportEvery && played % options.reportEvery == 0) {
+            progress();
+        }
+    }
+
+public:
+    void progress() const {
+        const Tally& t = tallies[0][1];
+        double error;
+        double e = elo(t, error);
+        cerr << played << " games: " << engines[0].name << " vs " << engines[1].name << " +"
+            << t.wins << " =" << t.draws << " -" << t.losses << fixed << setprecision(1) << ", elo " << e
+            << " +- " << error;
+        if (options.sprt) {
+            cerr << setprecision(2) << ", llr " << sprtLLR(t, options.elo0, options.elo1);
+        }
+        cerr << endl;
+    }
+
+    void report() const {
+        cout << played << " games" << (verdict.empty() ? "" : ", SPRT " + verdict) << endl << endl;
+        cout << left << setw(16) << "engine" << right << setw(8) << "games" << setw(9) << "win %"
+            << setw(10) << "cpu ms" << setw(10) << "max ms" << setw(12) << "nodes/move" << setw(10) << "forfeits"
+            << endl;
+        for (unsigned i = 0; i < stats.size(); i++) {
+            const EngineStats& s = stats[i];
+            long moves = max(1L, s.moves);
+            cout << left << setw(16) << engines[i].name << right << setw(8) << s.games << fixed
+                << setprecision(1) << setw(9) << 100.0 * s.wins / max(1L, s.games)
+                << setprecision(3) << setw(10) << s.cpuTime / 1000.0 / moves << setw(10) << s.maxCpuTime / 1000.0
+                << setw(12) << s.nodes / moves << setw(10) << s.forfeits << endl;
+        }
+        cout << endl;
+        for (unsigned a = 0; a < stats.size(); a++) {
+            for (unsigned b = a + 1; b < stats.size(); b++) {
+                const Tally& t = tallies[a][b];
+                double error;
+                double e = elo(t, error);
+                cout << engines[a].name << " vs " << engines[b].name << ": +" << t.wins << " ="
+                    << t.draws << " -" << t.losses << fixed << setprecision(1) << "  score "
+                    << 100 * t.score() << "%  elo " << showpos << e << noshowpos << " +- " << error;
+                if (options.sprt && a == 0 && b == 1) {
+                    cout << setprecision(2) << "  llr " << sprtLLR(t, options.elo0, options.elo1) << " ["
+                        << log(options.beta / (1 - options.alpha)) << ", "
+                        << log((1 - options.beta) / options.alpha) << "]";
+                }
+                cout << endl;
+            }
+        }
+    }
+};
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-e name:key=value,...]... [-n games] [-j threads] [-p players]... [-s seed]"
+        << " [-H hard_ms] [-S elo0,elo1|off] [-r report_every]" << endl;
+    cerr << "  engine settings: depth, pruning (on/off), margin, selective (cells, 0 for off), groups (on/off),"
+        << " time (ms of CPU per move, 0 for none), nodes (per move), params (file), or any evaluation parameter"
+        << " by name" << endl;
+    cerr << "  -H  a move taking more CPU time than this loses the game" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:n:j:p:s:H:S:r:")) != -1) {
+        Engine engine;
+        switch (opt) {
+        case 'e':
+            if (!engine.parse(optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+            options.engines.push_back(engine);
+            break;
+        case 'n':
+            options.games = atol(optarg);
+            break;
+        case 'j':
+            options.threads = max(1, atoi(optarg));
+            break;
+        case 'p':
+            options.playerCounts.push_back(min(PLAYERS, max(2, atoi(optarg))));
+            break;
+        case 's':
+            options.seed = atoi(optarg);
+            break;
+        case 'H':
+            options.hardLimit = atol(optarg);
+            break;
+        case 'S':
+            options.sprt = string(optarg) != "off";
+            if (options.sprt && sscanf(optarg, "%lf,%lf", &options.elo0, &options.elo1) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r':
+            options.reportEvery = atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    while (options.engines.size() < 2) {
+        Engine engine;
+        engine.name = options.engines.empty() ? "a" : "b";
+        options.engines.push_back(engine);
+    }
+    if (options.playerCounts.empty()) {
+        for (int players = 2; players <= PLAYERS; players++) {
+            options.playerCounts.push_back(players);
+        }
+    }
+
+    for (unsigned i = 0; i < options.engines.size(); i++) {
+        cout << options.engines[i].describe() << endl;
+    }
+    cout << options.threads << " threads" << endl;
+
+    Arena arena(options);
+    arena.run(options.threads);
+    arena.report();
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include <cstdlib>
+#include <map>
+#include "tron.cc"
+#include "tron_util.cc"
+
+// Time-to-solution benchmark over the position corpus. Each position is searched with increasing
+// depth; a position is solved at the shallowest depth from which every deeper search (up to the
+// position's own depth) plays a solving move. Positions without a known solution just report the
+// cost of the full-depth search.
+
+class BenchResult {
+public:
+    string name;
+    string solution;
+    string move;
+    // depth at which the position was solved, 0 if never, -1 if it has no solution
+    int solvedDepth;
+    long nodes;        // nodes needed to solve (or for the full search)
+    long time;         // microseconds needed to solve (or for the full search)
+    long totalNodes;   // nodes over all depths
+    long totalTime;
+
+    BenchResult() {
+        solvedDepth = -1;
+        nodes = time = totalNodes = totalTime = 0;
+    }
+};
+
+// Search a copy of the position, keeping the fastest of several runs
+const char* timedSearch(const State& s, const EvalVariant& variant, int depth, int selectiveRange, bool groups, int repeat,
+        long& nodes, long& time) {
+    void* evaluator = variant.create(EvalParams());
+    const char* move = 0;
+    time = LONG_MAX;
+    for (int r = 0; r < repeat; r++) {
+        State state = s;
+        state.maxDepth = depth;
+        state.selectiveRange = selectiveRange;
+        state.decompositionEnabled = groups;
+        state.timeLimitEnabled = false;
+        Scores scores;
+        Bounds bounds;
+        long start = micros();
+        variant.search(scores, bounds, state, 0, (void*) variant.search, evaluator);
+        long elapsed = micros() - start;
+        if (elapsed < time) {
+            time = elapsed;
+        }
+        nodes = state.nodesSearched;
+        move = scores.move;
+    }
+    variant.destroy(evaluator);
+    return move;
+}
+
+BenchResult bench(const Position& position, const EvalVariant& variant, int maxDepth, int selectiveRange, bool groups,
+        int repeat) {
+    BenchResult result;
+    result.name = position.name;
+    result.solution = position.solution();
+
+    int depth = maxDepth > 0 ? maxDepth : position.state.maxDepth;
+    vector<long> nodes(depth + 1), times(depth + 1);
+    vector<bool> solved(depth + 1);
+    for (int d = 1; d <= depth; d++) {
+        const char* move = timedSearch(position.state, variant, d, selectiveRange, groups, repeat, nodes[d], times[d]);
+        solved[d] = position.solvedBy(move);
+        result.totalNodes += nodes[d];
+        result.totalTime += times[d];
+        result.move = move;
+    }
+
+    if (!position.hasSolution()) {
+        result.nodes = nodes[depth];
+        result.time = times[depth];
+        return result;
+    }
+
+    result.solvedDepth = 0;
+    for (int d = depth; d >= 1 && solved[d]; d--) {
+        result.solvedDepth = d;
+    }
+    int last = result.solvedDepth ? result.solvedDepth : depth;
+    for (int d = 1; d <= last; d++) {
+        result.nodes += nodes[d];
+        result.time += times[d];
+    }
+    return result;
+}
+
+#define CSV_HEADER "position,solution,move,solved_depth,nodes,time_us,total_nodes,total_time_us"
+
+void writeResult(ostream& os, const BenchResult& r) {
+    os << r.name << "," << r.solution << "," << r.move << "," << r.solvedDepth << "," << r.nodes << ","
+        << r.time << "," << r.totalNodes << "," << r.totalTime << endl;
+}
+
+bool readResults(const char* path, map<string, BenchResult>& results) {
+    ifstream is(path);
+    if (!is) {
+        cerr << "Cannot open baseline " << path << endl;
+        return false;
+    }
+    string line;
+    getline(is, line);
+    while (getline(is, line)) {
+        vector<string> fields;
+        istringstream ls(line);
+        string field;
+        while (getline(ls, field, ',')) {
+            fields.push_back(field);
+        }
+        if (fields.size() != 8) {
+            continue;
+        }
+        BenchResult r;
+        r.name = fields[0];
+        r.solution = fields[1];
+        r.move = fields[2];
+        r.solvedDepth = atoi(fields[3].c_str());
+        r.nodes = atol(fields[4].c_str());
+        r.time = atol(fields[5].c_str());
+        r.totalNodes = atol(fields[6].c_str());
+        r.totalTime = atol(fields[7].c_str());
+        results[r.name] = r;
+    }
+    return true;
+}
+
+string depthString(int solvedDepth) {
+    if (solvedDepth < 0) {
+        return "-";
+    }
+    ostringstream os;
+    if (solvedDepth == 0) {
+        os << "FAIL";
+    } else {
+        os << "d" << solvedDepth;
+    }
+    return os.str();
+}
+
+// Print the result beside the baseline, returning false if the position got worse
+bool compare(const BenchResult& r, const BenchResult* base) {
+    cout << left << setw(20) << r.name << right << setw(6) << depthString(r.solvedDepth)
+        << setw(10) << r.nodes << setw(10) << r.time / 1000.0 << "ms";
+    if (!base) {
+        cout << "   (new)" << endl;
+        return true;
+    }
+    cout << "   was " << setw(4) << depthString(base->solvedDepth)
+        << setw(10) << base->nodes << setw(10) << base->time / 1000.0 << "ms"
+        << "   nodes x" << setprecision(3) << double(r.nodes) / max(1L, base->nodes)
+        << "   time x" << setprecision(3) << double(r.time) / max(1L, base->time);
+
+    bool lost = base->solvedDepth > 0 && (r.solvedDepth == 0 || r.solvedDepth > base->solvedDepth);
+    bool gained = r.solvedDepth > 0 && (base->solvedDepth == 0 || r.solvedDepth < base->solvedDepth);
+    cout << (lost ? "   WORSE" : gained ? "   BETTER" : "") << endl;
+    return !lost;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-c corpus] [-o results.csv] [-b baseline.csv] [-d depth] [-x range] [-g]"
+        << " [-r repeat] [-e evaluator] [name...]" << endl;
+    cerr << "  -x  selective search: extend near contact and reduce out of reach, within this many cells" << endl;
+    cerr << "  -g  search only our group of players, whose regions meet ours, letting the others pass" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* corpusPath = CORPUS_PATH;
+    const char* outputPath = "bench.csv";
+    const char* baselinePath = 0;
+    int maxDepth = 0;
+    int selectiveRange = 0;
+    bool groups = false;
+    int repeat = 3;
+    const EvalVariant* variant = &evalVariants[0];
+    int opt;
+    while ((opt = getopt(argc, argv, "c:o:b:d:x:gr:e:")) != -1) {
+        switch (opt) {
+        case 'c':
+            corpusPath = optarg;
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        case 'b':
+            baselinePath = optarg;
+            break;
+        case 'd':
+            maxDepth = atoi(optarg);
+            break;
+        case 'x':
+            selectiveRange = atoi(optarg);
+            break;
+        case 'g':
+            groups = true;
+            break;
+        case 'r':
+            repeat = max(1, atoi(optarg));
+            break;
+        case 'e':
+            variant = findEvalVariant(optarg);
+            if (!variant) {
+                cerr << "Unknown evaluator " << optarg << endl;
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    vector<Position> positions;
+    if (!loadCorpus(corpusPath, positions)) {
+        return 1;
+    }
+    map<string, BenchResult> baseline;
+    if (baselinePath && !readResults(baselinePath, baseline)) {
+        return 1;
+    }
+
+    ofstream os(outputPath);
+    os << CSV_HEADER << endl;
+
+    bool ok = true;
+    for (unsigned i = 0; i < positions.size(); i++) {
+        const Position& position = positions[i];
+        if (optind < argc && find(argv + optind, argv + argc, position.name) == argv + argc) {
+            continue;
+        }
+        BenchResult result = bench(position, *variant, maxDepth, selectiveRange, groups, repeat);
+        writeResult(os, result);
+        map<string, BenchResult>::const_iterator base = baseline.find(result.name);
+        if (!compare(result, baselinePath && base != baseline.end() ? &base->second : 0)) {
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+#include <map>
+#include "tron.cc"
+#include "tron_util.cc"
+#include "tron_game.cc"
+
+// Opening book builder. Collects the positions of the first turns of games, from self-play from
+// random starts and from the bot's game logs (-l), folds together those which are mirror images
+// of each other, and searches each position seen often enough far deeper than a move's time
+// allows. The moves are written as a book for the bot's -b option.
+
+class Opening {
+public:
+    State state;
+    int symmetry;     // which maps the position to its canonical image
+    int seen;
+};
+
+class BookBuilder {
+private:
+    pthread_mutex_t lock;
+    unsigned next;
+
+    long claim() {
+        pthread_mutex_lock(&lock);
+        long index = next < openings.size() ? long(next++) : -1;
+        pthread_mutex_unlock(&lock);
+        return index;
+    }
+
+    void search(const Opening& opening, void* evaluator, BookEntry& entry) const {
+        State state = opening.state;
+        engine.configure(state);
+        state.resetTimer();
+        Scores scores;
+        Bounds bounds;
+        const EvalVariant* variant = engine.variant;
+        variant->search(scores, bounds, state, 0, (void*) variant->search, evaluator);
+
+        memset(&entry, 0, sizeof(entry));
+        entry.key = state.key(opening.symmetry);
+        entry.score = scores.scores[state.thisPlayer];
+        int move = moveIndex(scores.move);
+        entry.move = move < 4 ? symmetricMove(move, opening.symmetry) : move;
+        entry.depth = state.maxDepth;
+    }
+
+    static void* worker(void* data) {
+        BookBuilder& builder = *(BookBuilder*) data;
+        void* evaluator = builder.engine.variant->create(builder.engine.params);
+        long index;
+        while ((index = builder.claim()) >= 0) {
+            builder.search(builder.openings[index], evaluator, builder.entries[index]);
+        }
+        builder.engine.variant->destroy(evaluator);
+        return 0;
+    }
+
+public:
+    Engine engine;
+    map<uint64_t, Opening> seen;
+    vector<Opening> openings;
+    vector<BookEntry> entries;
+
+    BookBuilder() : next(0) {
+        pthread_mutex_init(&lock, 0);
+        engine.name = "book";
+        engine.maxDepth = 12;
+        engine.timeLimit = 0;
+    }
+
+    void add(const State& state) {
+        int symmetry;
+        uint64_t key = state.canonicalKey(symmetry);
+        map<uint64_t, Opening>::iterator i = seen.find(key);
+        if (i != seen.end()) {
+            i->second.seen++;
+            return;
+        }
+        Opening& opening = seen[key];
+        opening.state = state;
+        opening.symmetry = symmetry;
+        opening.seen = 1;
+    }
+
+    // The positions seen at least minSeen times, most often seen first, up to maxEntries
+    void select(int minSeen, unsigned maxEntries) {
+        vector<pair<int, uint64_t> > counts;
+        for (map<uint64_t, Opening>::iterator i = seen.begin(); i != seen.end(); ++i) {
+            if (i->second.seen >= minSeen) {
+                counts.push_back(make_pair(-i->second.seen, i->first));
+            }
+        }
+        sort(counts.begin(), counts.end());
+        for (unsigned i = 0; i < counts.size() && i < maxEntries; i++) {
+            openings.push_back(seen[counts[i].second]);
+        }
+    }
+
+    void run(int threads) {
+        entries.resize(openings.size());
+        vector<pthread_t> workers(threads);
+        for (int i = 0; i < threads; i++) {
+            pthread_create(&workers[i], 0, worker, this);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i], 0);
+        }
+    }
+};
+
+// The positions of the first turns of self-play games from random starts. The players are quick
+// fixed-budget searchers, as only the positions matter.
+void playOpenings(BookBuilder& builder, const vector<int>& playerCounts, long games, int turns, unsigned seed) {
+    vector<Engine> engines(1);
+    engines[0].timeLimit = 0;
+    engines[0].nodeLimit = 2000;
+    int seats[PLAYERS] = {0};
+    for (long game = 0; game < games; game++) {
+        int numPlayers = playerCounts[game % playerCounts.size()];
+        int starts[PLAYERS][2];
+        randomStarts(numPlayers, rand_r(&seed), starts);
+        GameResult result;
+        vector<State> positions;
+        playGame(engines, numPlayers, seats, starts, 0, result, turns, &positions);
+        for (unsigned i = 0; i < positions.size(); i++) {
+            builder.add(positions[i]);
+        }
+    }
+}
+
+inline bool compatibleLog(const LogHeader& header) {
+    return header.width == WIDTH && header.height == HEIGHT && header.players == PLAYERS
+        && header.recordSize == sizeof(TurnRecord);
+}
+
+// The positions of the first turns of every game in a log written by the bot's -l option
+bool readLog(BookBuilder& builder, const char* path, int turns) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    LogHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || !isLogHeader(&header)) {
+        fclose(file);
+        return false;
+    }
+    bool compatible = compatibleLog(header);
+    State state;
+    int turn = 0;
+    TurnRecord record;
+    // headers and records are the same size, so each block is one or the other
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (isLogHeader(&record)) {
+            compatible = compatibleLog(*(const LogHeader*) &record);
+            state = State();
+            turn = 0;
+            continue;
+        }
+        if (!compatible || turn >= turns) {
+            continue;
+        }
+        TurnInput input;
+        record.get(input);
+        state.applyTurn(input);
+        builder.add(state);
+        turn++;
+    }
+    fclose(file);
+    return true;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-n games] [-p players]... [-T turns] [-l gamelog]... [-m min_seen] [-N max_entries]"
+        << " [-d depth] [-e name:key=value,...] [-j threads] [-s seed] [-o book]" << endl;
+    cerr << "  -n  self-play games from random starts (default 200, or none with -l)" << endl;
+    cerr << "  -T  turns of each game to collect" << endl;
+    cerr << "  -m  times a position, or a mirror image of it, must be seen to enter the book" << endl;
+    cerr << "  -d  search depth for the book's moves; engine settings are as for tron_arena" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BookBuilder builder;
+    long games = -1;
+    vector<int> playerCounts;
+    int turns = 4;
+    vector<const char*> logs;
+    int minSeen = 1;
+    unsigned maxEntries = 100000;
+    int depth = 0;
+    int threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    unsigned seed = 1;
+    const char* outputPath = "book.bin";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:T:l:m:N:d:e:j:s:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            games = atol(optarg);
+            break;
+        case 'p':
+            playerCounts.push_back(min(PLAYERS, max(2, atoi(optarg))));
+            break;
+        case 'T':
+            turns = max(1, atoi(optarg));
+            break;
+        case 'l':
+            logs.push_back(optarg);
+            break;
+        case 'm':
+            minSeen = max(1, atoi(optarg));
+            break;
+        case 'N':
+            maxEntries = atol(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'e':
+            if (!builder.engine.parse(optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            threads = max(1, atoi(optarg));
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    // -d overrides the engine's depth, whichever order they came in
+    if (depth) {
+        builder.engine.maxDepth = depth;
+    }
+    if (games < 0) {
+        games = logs.empty() ? 200 : 0;
+    }
+    if (playerCounts.empty()) {
+        playerCounts.push_back(2);
+    }
+
+    for (unsigned i = 0; i < logs.size(); i++) {
+        if (!readLog(builder, logs[i], turns)) {
+            cerr << "Cannot read game log " << logs[i] << endl;
+            return 1;
+        }
+    }
+    playOpenings(builder, playerCounts, games, turns, seed);
+    builder.select(minSeen, maxEntries);
+    cerr << builder.seen.size() << " distinct positions, " << builder.openings.size() << " to search with "
+        << builder.engine.describe() << endl;
+
+    threads = max(1, min(threads, (int) builder.openings.size()));
+    long start = micros();
+    builder.run(threads);
+    long elapsed = micros() - start;
+
+    if (!writeBook(outputPath, builder.entries)) {
+        cerr << "Cannot write " << outputPath << endl;
+        return 1;
+    }
+    cerr << builder.entries.size() << " entries written to " << outputPath << " in " << fixed << setprecision(1)
+        << elapsed / 1e6 << "s" << endl;
+    return 0;
+}
@@ -0,0 +1,476 @@
+// Engine variants and an in-process referee, shared by the tools which play games between
+// engines. Include after tron.cc.
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+long threadMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// A named set of search and evaluation settings, written as "name:key=value,key=value". The
+// evaluator is chosen with eval=variant; any evaluation parameter can be set by name, or all of
+// them from a file with params=path.
+class Engine {
+public:
+    string name;
+    int maxDepth;
+    bool pruningEnabled;
+    int pruneMargin;
+    int selectiveRange;
+    bool decompositionEnabled;
+    int timeLimit;    // milliseconds of thread CPU time per move, 0 for none
+    int nodeLimit;    // search nodes per move, 0 for none
+    const EvalVariant* variant;
+    EvalParams params;
+
+    Engine() {
+        variant = &evalVariants[0];
+        State defaults;
+        maxDepth = defaults.maxDepth;
+        pruningEnabled = defaults.pruningEnabled;
+        pruneMargin = defaults.pruneMargin;
+        selectiveRange = defaults.selectiveRange;
+        decompositionEnabled = defaults.decompositionEnabled;
+        timeLimit = defaults.timeLimit;
+        nodeLimit = defaults.nodeLimit;
+    }
+
+    bool set(const string& key, const string& value) {
+        int n = atoi(value.c_str());
+        if (key == "depth") {
+            maxDepth = n;
+        } else if (key == "pruning") {
+            pruningEnabled = value == "on";
+        } else if (key == "margin") {
+            pruneMargin = n;
+        } else if (key == "selective") {
+            selectiveRange = n;
+        } else if (key == "groups") {
+            decompositionEnabled = value == "on";
+        } else if (key == "time") {
+            timeLimit = n;
+        } else if (key == "nodes") {
+            nodeLimit = n;
+        } else if (key == "eval") {
+            variant = findEvalVariant(value);
+            return variant != 0;
+        } else if (key == "params") {
+            ifstream is(value.c_str());
+            return is && params.read(is);
+        } else if (EvalParams::find(key) >= 0) {
+            params[EvalParams::find(key)] = n;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool parse(const string& spec) {
+        size_t colon = spec.find(':');
+        name = spec.substr(0, colon);
+        if (colon == string::npos) {
+            return !name.empty();
+        }
+        istringstream is(spec.substr(colon + 1));
+        string setting;
+        while (getline(is, setting, ',')) {
+            size_t equals = setting.find('=');
+            if (equals == string::npos || !set(setting.substr(0, equals), setting.substr(equals + 1))) {
+                cerr << "Bad engine setting " << setting << " in " << spec << endl;
+                return false;
+            }
+        }
+        return !name.empty();
+    }
+
+    string describe() const {
+        ostringstream os;
+        os << name << ": depth " << maxDepth << ", pruning " << (pruningEnabled ? "on" : "off")
+            << ", margin " << pruneMargin << ", time " << timeLimit << "ms";
+        if (nodeLimit) {
+            os << ", nodes " << nodeLimit;
+        }
+        if (selectiveRange) {
+            os << ", selective " << selectiveRange;
+        }
+        if (decompositionEnabled) {
+            os << ", groups on";
+        }
+        if (variant != &evalVariants[0]) {
+            os << ", eval " << variant->name;
+        }
+        EvalParams defaults;
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            if (params[i] != defaults[i]) {
+                os << ", " << evalParamNames[i] << " " << params[i];
+            }
+        }
+        return os.str();
+    }
+
+    void configure(State& state) const {
+        state.maxDepth = maxDepth;
+        state.pruningEnabled = pruningEnabled;
+        state.pruneMargin = pruneMargin;
+        state.selectiveRange = selectiveRange;
+        state.decompositionEnabled = decompositionEnabled;
+        state.timeLimitEnabled = timeLimit > 0;
+        state.timeLimit = timeLimit;
+        state.clock = threadMillis;
+        state.nodeLimit = nodeLimit;
+        if (nodeLimit > 0) {
+            // a node budget replaces the time limit, so the engine's games repeat exactly
+            state.setNodeBudget(nodeLimit);
+        }
+    }
+};
+
+// One player's side of a game. Like the bot process, it keeps its own board and rebuilds it from
+// the referee's input each turn.
+class Bot {
+public:
+    const Engine* engine;
+    State state;
+    void* evaluator;
+    long moves;
+    long cpuTime;     // microseconds over all moves
+    long maxCpuTime;
+    long nodes;
+
+    Bot() {
+        engine = 0;
+        evaluator = 0;
+        moves = cpuTime = maxCpuTime = nodes = 0;
+    }
+
+    ~Bot() {
+        if (evaluator) {
+            engine->variant->destroy(evaluator);
+        }
+    }
+
+    int move(const TurnInput& input) {
+        state.applyTurn(input);
+        engine->configure(state);
+        state.resetTimer();
+        if (!evaluator) {
+            evaluator = engine->variant->create(engine->params);
+        }
+
+        Scores scores;
+        Bounds bounds;
+        const EvalVariant* variant = engine->variant;
+        long start = threadMicros();
+        variant->search(scores, bounds, state, 0, (void*) variant->search, evaluator);
+        long elapsed = threadMicros() - start;
+
+        moves++;
+        cpuTime += elapsed;
+        maxCpuTime = max(maxCpuTime, elapsed);
+        nodes += state.nodesSearched;
+        return moveIndex(scores.move);
+    }
+};
+
+class GameResult {
+public:
+    int numPlayers;
+    int seats[PLAYERS];     // engine playing each seat
+    int ranks[PLAYERS];     // 0 for the winner, then in reverse order of death
+    int turns;
+    int forfeits;           // seats which lost by going over the hard time limit
+    long moves[PLAYERS];
+    long cpuTime[PLAYERS];
+    long maxCpuTime[PLAYERS];
+    long nodes[PLAYERS];
+};
+
+// Distinct random start cells for each player
+void randomStarts(int numPlayers, unsigned seed, int starts[PLAYERS][2]) {
+    for (int i = 0; i < numPlayers; i++) {
+        bool taken;
+        do {
+            starts[i][0] = rand_r(&seed) % WIDTH;
+            starts[i][1] = rand_r(&seed) % HEIGHT;
+            taken = false;
+            for (int j = 0; j < i; j++) {
+                taken = taken || (starts[j][0] == starts[i][0] && starts[j][1] == starts[i][1]);
+            }
+        } while (taken);
+    }
+}
+
+// Play a game to the end under the referee's rules: players move in turn, a player who moves
+// into a wall or trail (or takes longer than hardLimit ms, if set) dies, and its trail is removed.
+// To collect openings, a game can instead stop after turnLimit turns, and add every position a
+// player searched to positions.
+void playGame(const vector<Engine>& engines, int numPlayers, const int seats[PLAYERS], const int starts[PLAYERS][2],
+        long hardLimit, GameResult& result, int turnLimit = 0, vector<State>* positions = 0) {
+    State board;
+    board.numPlayers = numPlayers;
+    TurnInput input;
+    input.numPlayers = numPlayers;
+    Bot bots[PLAYERS];
+    for (int i = 0; i < numPlayers; i++) {
+        bots[i].engine = &engines[seats[i]];
+        board.occupy(starts[i][0], starts[i][1], i);
+        input.coords[i][0] = input.coords[i][2] = starts[i][0];
+        input.coords[i][1] = input.coords[i][3] = starts[i][1];
+        result.seats[i] = seats[i];
+    }
+    result.numPlayers = numPlayers;
+    result.turns = 0;
+    result.forfeits = 0;
+
+    while (board.livingCount() > 1 && (!turnLimit || result.turns < turnLimit)) {
+        for (int i = 0; i < numPlayers && board.livingCount() > 1; i++) {
+            if (!board.isAlive(i)) {
+                continue;
+            }
+            input.thisPlayer = i;
+            long before = bots[i].cpuTime;
+            int move = bots[i].move(input);
+            if (positions) {
+                positions->push_back(bots[i].state);
+            }
+            bool forfeit = hardLimit > 0 && bots[i].cpuTime - before > hardLimit * 1000;
+            int x = board.players[i].x + (move < 4 ? xOffsets[move] : 0);
+            int y = board.players[i].y + (move < 4 ? yOffsets[move] : 0);
+            if (move == 4 || forfeit || board.occupied(x, y)) {
+                board.kill(i);
+                for (int j = 0; j < 4; j++) {
+                    input.coords[i][j] = -1;
+                }
+                result.forfeits |= forfeit << i;
+            } else {
+                board.occupy(x, y, i);
+                input.coords[i][2] = x;
+                input.coords[i][3] = y;
+            }
+        }
+        result.turns++;
+    }
+
+    for (int i = 0; i < numPlayers; i++) {
+        result.ranks[i] = 0;
+        result.moves[i] = bots[i].moves;
+        result.cpuTime[i] = bots[i].cpuTime;
+        result.maxCpuTime[i] = bots[i].maxCpuTime;
+        result.nodes[i] = bots[i].nodes;
+    }
+    for (int j = 0; j < board.deathCount; j++) {
+        result.ranks[board.deadList[j]] = numPlayers - 1 - j;
+    }
+}
+
+// Wins, draws and losses of one engine against another
+class Tally {
+public:
+    long wins;
+    long draws;
+    long losses;
+
+    Tally() {
+        wins = draws = losses = 0;
+    }
+
+    inline long games() const {
+        return wins + draws + losses;
+    }
+
+    inline double score() const {
+        return games() ? (wins + draws / 2.0) / games() : 0.5;
+    }
+
+    // Variance of the score of a single game
+    double variance() const {
+        double s = score();
+        long n = games();
+        if (!n) {
+            return 0;
+        }
+        return (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / n;
+    }
+};
+
+inline double scoreToElo(double score) {
+    score = min(max(score, 1e-6), 1 - 1e-6);
+    return -400 * log10(1 / score - 1);
+}
+
+inline double eloToScore(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+// Elo difference with the half-width of its 95% confidence interval
+double elo(const Tally& tally, double& error) {
+    double s = tally.score();
+    double margin = tally.games() ? 1.96 * sqrt(tally.variance() / tally.games()) : 0.5;
+    error = (scoreToElo(s + margin) - scoreToElo(s - margin)) / 2;
+    return scoreToElo(s);
+}
+
+// Log-likelihood ratio of the hypothesis elo1 against elo0, using the normal approximation to the
+// game score distribution
+double sprtLLR(const Tally& tally, double elo0, double elo1) {
+    double var = tally.variance();
+    if (tally.games() == 0 || var == 0) {
+        return 0;
+    }
+    double s0 = eloToScore(elo0);
+    double s1 = eloToScore(elo1);
+    return tally.games() * (s1 - s0) * (2 * tally.score() - s0 - s1) / (2 * var);
+}
+
+class EngineStats {
+public:
+    long games;
+    long wins;
+    long moves;
+    long cpuTime;
+    long maxCpuTime;
+    long nodes;
+    long forfeits;
+
+    EngineStats() {
+        games = wins = moves = cpuTime = maxCpuTime = nodes = forfeits = 0;
+    }
+};
+
+// A batch of games between engines, played by worker threads from random starts. Each start
+// position is played once per engine with the seats rotated, so that every engine gets every
+// seat. Each game counts once for each pair of engines in it, won by whichever engine's best
+// seat finished higher, so that the seats of one game are not taken for independent games.
+class Match {
+private:
+    pthread_mutex_t lock;
+    long nextGame;
+    bool stopped;
+
+    // Claim the next game to play, or return -1 when the match is over
+    long claim() {
+        pthread_mutex_lock(&lock);
+        long game = stopped || nextGame >= games ? -1 : nextGame++;
+        pthread_mutex_unlock(&lock);
+        return game;
+    }
+
+    void setUp(long game, int& numPlayers, int seats[PLAYERS], int starts[PLAYERS][2]) const {
+        int engineCount = engines.size();
+        long start = game / engineCount;
+        int rotation = game % engineCount;
+        numPlayers = playerCounts[start % playerCounts.size()];
+        for (int i = 0; i < numPlayers; i++) {
+            seats[i] = (i + rotation) % engineCount;
+        }
+        randomStarts(numPlayers, seed + start * 7919, starts);
+    }
+
+    void record(const GameResult& result) {
+        pthread_mutex_lock(&lock);
+        for (int i = 0; i < result.numPlayers; i++) {
+            int a = result.seats[i];
+            EngineStats& s = stats[a];
+            s.games++;
+            s.wins += result.ranks[i] == 0;
+            s.moves += result.moves[i];
+            s.cpuTime += result.cpuTime[i];
+            s.maxCpuTime = max(s.maxCpuTime, result.maxCpuTime[i]);
+            s.nodes += result.nodes[i];
+            s.forfeits += (result.forfeits >> i) & 1;
+        }
+        // an engine holding several seats finished where its best seat did
+        int engineCount = engines.size();
+        vector<int> best(engineCount, INT_MAX);
+        for (int i = 0; i < result.numPlayers; i++) {
+            best[result.seats[i]] = min(best[result.seats[i]], result.ranks[i]);
+        }
+        for (int a = 0; a < engineCount; a++) {
+            for (int b = 0; b < engineCount; b++) {
+                if (a == b || best[a] == INT_MAX || best[b] == INT_MAX) {
+                    continue;
+                }
+                Tally& t = tallies[a][b];
+                if (best[a] < best[b]) {
+                    t.wins++;
+                } else if (best[a] > best[b]) {
+                    t.losses++;
+                } else {
+                    t.draws++;
+                }
+            }
+        }
+        played++;
+        recorded();
+        pthread_mutex_unlock(&lock);
+    }
+
+    static void* worker(void* data) {
+        Match& match = *(Match*) data;
+        long game;
+        while ((game = match.claim()) >= 0) {
+            int numPlayers;
+            int seats[PLAYERS];
+            int starts[PLAYERS][2];
+            match.setUp(game, numPlayers, seats, starts);
+            GameResult result;
+            playGame(match.engines, numPlayers, seats, starts, match.hardLimit, result);
+            match.record(result);
+        }
+        return 0;
+    }
+
+protected:
+    // Called with the lock held after each game is recorded
+    virtual void recorded() {}
+
+    // End the match early; games already being played still count
+    inline void stop() {
+        stopped = true;
+    }
+
+    inline bool isStopped() const {
+        return stopped;
+    }
+
+public:
+    vector<Engine> engines;
+    vector<int> playerCounts;
+    long games;
+    unsigned seed;
+    long hardLimit;   // milliseconds of CPU time after which a move loses, 0 for none
+    long played;
+    vector<EngineStats> stats;
+    // tallies[a][b] is engine a's record against engine b
+    vector<vector<Tally> > tallies;
+
+    Match(const vector<Engine>& p_engines, const vector<int>& p_playerCounts, long p_games, unsigned p_seed)
+            : nextGame(0), stopped(false), engines(p_engines), playerCounts(p_playerCounts), games(p_games),
+            seed(p_seed), hardLimit(0), played(0) {
+        pthread_mutex_init(&lock, 0);
+        stats.resize(engines.size());
+        tallies.resize(engines.size(), vector<Tally>(engines.size()));
+    }
+
+    virtual ~Match() {
+        pthread_mutex_destroy(&lock);
+    }
+
+    void run(int threads) {
+        vector<pthread_t> ids(max(1, threads));
+        for (unsigned i = 0; i < ids.size(); i++) {
+            pthread_create(&ids[i], 0, worker, this);
+        }
+        for (unsigned i = 0; i < ids.size(); i++) {
+            pthread_join(ids[i], 0);
+        }
+    }
+};
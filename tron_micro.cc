@@ -0,0 +1,337 @@
+#include "tron.cc"
+#include "tron_util.cc"
+
+// Microbenchmarks for the engine's hot paths. Each benchmark runs an operation in batches large
+// enough to time reliably, and reports the median and 99th percentile cost per operation over
+// the repetitions, after some warmup batches. Where the kernel allows it, hardware performance
+// counters are read over the repetitions and reported per operation.
+
+class Bench {
+protected:
+    State state;
+    // free cells and the moves out of them, so each operation sees a realistic mix
+    vector<int> cellX;
+    vector<int> cellY;
+    vector<int> cellDir;
+
+public:
+    long extra;
+
+    Bench(const State& s) : state(s), extra(0) {
+        for (int x = 0; x < WIDTH; x++) {
+            for (int y = 0; y < HEIGHT; y++) {
+                for (int d = 0; d < 4; d++) {
+                    if (!state.occupied(x, y) && !state.occupied(x + xOffsets[d], y + yOffsets[d])) {
+                        cellX.push_back(x);
+                        cellY.push_back(y);
+                        cellDir.push_back(d);
+                    }
+                }
+            }
+        }
+    }
+
+    virtual ~Bench() {}
+
+    // Run the operation n times
+    virtual void run(int n) = 0;
+
+    virtual string note() const {
+        return "";
+    }
+};
+
+class OccupyBench : public Bench {
+public:
+    OccupyBench(const State& s) : Bench(s) {}
+
+    void run(int n) {
+        int cells = cellX.size();
+        for (int i = 0; i < n; i++) {
+            int c = i % cells;
+            int player = i % state.numPlayers;
+            state.occupy(cellX[c], cellY[c], player);
+            state.unoccupy(cellX[c], cellY[c], player);
+        }
+    }
+};
+
+class IsDoorBench : public Bench {
+public:
+    IsDoorBench(const State& s) : Bench(s) {}
+
+    void run(int n) {
+        int cells = cellX.size();
+        int doors = 0;
+        for (int i = 0; i < n; i++) {
+            int c = i % cells;
+            doors += state.isDoor(cellX[c], cellY[c], xOffsets[cellDir[c]], yOffsets[cellDir[c]]);
+        }
+        extra += doors;
+    }
+};
+
+class VoronoiBench : public Bench {
+    Voronoi voronoi;
+
+public:
+    VoronoiBench(const State& s) : Bench(s) {}
+
+    void run(int n) {
+        for (int i = 0; i < n; i++) {
+            voronoi.calculate(state, i % state.numPlayers);
+        }
+        extra += voronoi.playerRegionSize(0);
+    }
+};
+
+class RegionSizeBench : public Bench {
+    Voronoi voronoi;
+
+public:
+    RegionSizeBench(const State& s) : Bench(s) {
+        voronoi.calculate(state);
+    }
+
+    void run(int n) {
+        for (int i = 0; i < n; i++) {
+            voronoi.calculateRegionSizes(state);
+        }
+        extra += voronoi.playerRegionSize(0);
+    }
+};
+
+// Runs an evaluator variant
+class VariantBench : public Bench {
+protected:
+    const EvalVariant& variant;
+    void* evaluator;
+
+public:
+    VariantBench(const State& s, const EvalVariant& p_variant) : Bench(s), variant(p_variant) {
+        evaluator = variant.create(EvalParams());
+    }
+
+    ~VariantBench() {
+        variant.destroy(evaluator);
+    }
+};
+
+class ScoresBench : public VariantBench {
+    Scores scores;
+
+public:
+    ScoresBench(const State& s, const EvalVariant& variant) : VariantBench(s, variant) {}
+
+    void run(int n) {
+        for (int i = 0; i < n; i++) {
+            variant.evaluate(scores, evaluator, state, i % state.numPlayers);
+        }
+        extra += scores.scores[0];
+    }
+};
+
+class MinimaxBench : public VariantBench {
+    int depth;
+
+public:
+    long nodes;
+
+    MinimaxBench(const State& s, const EvalVariant& variant, int p_depth)
+        : VariantBench(s, variant), depth(p_depth), nodes(0) {}
+
+    void run(int n) {
+        for (int i = 0; i < n; i++) {
+            State search = state;
+            search.maxDepth = depth;
+            Scores scores;
+            Bounds bounds;
+            variant.search(scores, bounds, search, 0, (void*) variant.search, evaluator);
+            nodes = search.nodesSearched;
+        }
+    }
+
+    string note() const {
+        ostringstream os;
+        os << nodes << " nodes/search";
+        return os.str();
+    }
+};
+
+class Options {
+public:
+    int warmup;
+    int repetitions;
+    long sampleNanos;
+    int maxDepth;
+    vector<const EvalVariant*> variants;
+    string filter;
+    PerfCounters* perf;
+
+    Options() {
+        warmup = 3;
+        repetitions = 31;
+        sampleNanos = 2000000;
+        maxDepth = 8;
+        perf = 0;
+    }
+};
+
+// Time the benchmark, returning nanoseconds per operation for each repetition, and the counters
+// per operation over all the repetitions
+Stats measure(Bench& bench, const Options& options, long& batch, double counters[PERF_COUNTERS]) {
+    // Find a batch size which takes at least sampleNanos
+    batch = 1;
+    while (true) {
+        long start = nanos();
+        bench.run(batch);
+        long elapsed = nanos() - start;
+        if (elapsed >= options.sampleNanos || batch >= (1 << 24)) {
+            break;
+        }
+        batch *= elapsed > 0 ? min(16L, max(2L, options.sampleNanos / elapsed + 1)) : 16;
+    }
+    for (int i = 0; i < options.warmup; i++) {
+        bench.run(batch);
+    }
+    vector<double> samples;
+    fill(counters, counters + PERF_COUNTERS, 0.0);
+    for (int i = 0; i < options.repetitions; i++) {
+        long start = nanos();
+        options.perf->start();
+        bench.run(batch);
+        options.perf->stop();
+        samples.push_back(double(nanos() - start) / batch);
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            long value = options.perf->values[k];
+            counters[k] = value < 0 || counters[k] < 0 ? -1 : counters[k] + double(value) / batch;
+        }
+    }
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        if (counters[k] >= 0) {
+            counters[k] /= options.repetitions;
+        }
+    }
+    return Stats(samples);
+}
+
+void report(const string& name, int players, int density, const Stats& stats, long batch,
+        const double counters[PERF_COUNTERS], bool countersEnabled, const string& note) {
+    cout << left << setw(16) << name << right << setw(3) << players << "p " << left << setw(7)
+        << densityNames[density] << right << fixed << setprecision(1)
+        << setw(14) << stats.median << setw(14) << stats.p99 << setw(10) << batch;
+    if (countersEnabled) {
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            if (counters[k] >= 0) {
+                cout << setw(18) << counters[k];
+            } else {
+                cout << setw(18) << "-";
+            }
+        }
+    }
+    cout << "  " << note << endl;
+}
+
+void runBench(const string& name, Bench& bench, int players, int density, const Options& options) {
+    if (name.find(options.filter) == string::npos) {
+        return;
+    }
+    long batch;
+    double counters[PERF_COUNTERS];
+    Stats stats = measure(bench, options, batch, counters);
+    report(name, players, density, stats, batch, counters, options.perf->available(), bench.note());
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-w warmup] [-r repetitions] [-s sample_ms] [-d max_depth] [-e evaluator]..."
+        << " [-C] [filter]" << endl;
+    cerr << "  -e  benchmark the scoring and search of these evaluators (default: standard)" << endl;
+    cerr << "  -C  do not read hardware performance counters" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    PerfCounters perf;
+    options.perf = &perf;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:s:d:e:C")) != -1) {
+        switch (opt) {
+        case 'w':
+            options.warmup = atoi(optarg);
+            break;
+        case 'r':
+            options.repetitions = atoi(optarg);
+            break;
+        case 's':
+            options.sampleNanos = atol(optarg) * 1000000L;
+            break;
+        case 'd':
+            options.maxDepth = atoi(optarg);
+            break;
+        case 'e': {
+            const EvalVariant* variant = findEvalVariant(optarg);
+            if (!variant) {
+                cerr << "Unknown evaluator " << optarg << endl;
+                return 1;
+            }
+            options.variants.push_back(variant);
+            break;
+        }
+        case 'C':
+            perf.disable();
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        options.filter = argv[optind];
+    }
+    if (options.variants.empty()) {
+        options.variants.push_back(&evalVariants[0]);
+    }
+
+    if (!perf.available() && perf.error.size()) {
+        cerr << "Hardware counters unavailable (" << perf.error << "), reporting times only" << endl;
+    }
+    cout << left << setw(16) << "benchmark" << right << setw(3) << "" << "  " << left << setw(7) << "board"
+        << right << setw(14) << "median ns/op" << setw(14) << "p99 ns/op" << setw(10) << "batch";
+    if (perf.available()) {
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            cout << setw(18) << string(perfCounterNames[k]) + "/op";
+        }
+    }
+    cout << endl;
+
+    for (int players = 2; players <= PLAYERS; players++) {
+        for (int density = 0; density < DENSITIES; density++) {
+            State state;
+            benchmarkBoard(state, players, density, 199);
+
+            OccupyBench occupy(state);
+            runBench("occupy+unoccupy", occupy, players, density, options);
+            IsDoorBench isDoor(state);
+            runBench("isDoor", isDoor, players, density, options);
+            VoronoiBench voronoi(state);
+            runBench("voronoi", voronoi, players, density, options);
+            RegionSizeBench regionSize(state);
+            runBench("regionSize", regionSize, players, density, options);
+
+            for (unsigned v = 0; v < options.variants.size(); v++) {
+                const EvalVariant& variant = *options.variants[v];
+                string suffix = options.variants.size() > 1 ? string("[") + variant.name + "]" : "";
+                ScoresBench scores(state, variant);
+                runBench("scores" + suffix, scores, players, density, options);
+
+                for (int depth = 1; depth <= options.maxDepth; depth++) {
+                    ostringstream name;
+                    name << "minimax/" << depth << suffix;
+                    MinimaxBench minimax(state, variant, depth);
+                    runBench(name.str(), minimax, players, density, options);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "tron.cc"
+#include "tron_util.cc"
+
+// Move generation and make/unmake check. Counts the leaves of the game tree under the minimax
+// turn rules, without any evaluation, and compares them with the counts stored in the perft file.
+
+#define PERFT_PATH "perft.txt"
+
+// Print the leaf count below each root move
+void divide(State& state, int depth, bool verify) {
+    int player = state.thisPlayer;
+    int origX = state.players[player].x;
+    int origY = state.players[player].y;
+    for (int i = 0; i < 4; i++) {
+        int x = origX + xOffsets[i];
+        int y = origY + yOffsets[i];
+        if (!state.occupied(x, y)) {
+            state.makeMove(player, x, y);
+            cout << "  " << setw(5) << dirs[i] << " " << perft(state, 1, depth, verify) << endl;
+            state.unmakeMove();
+        }
+    }
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-f perft.txt] [-d depth] [-v] [-D] [name...]" << endl;
+    cerr << "  -d  search to this depth, printing counts (default: check the stored counts)" << endl;
+    cerr << "  -v  check that every unmade move restores the board" << endl;
+    cerr << "  -D  divide: print the count below each root move" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = PERFT_PATH;
+    int maxDepth = 0;
+    bool verify = false;
+    bool divided = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:d:vD")) != -1) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'd':
+            maxDepth = atoi(optarg);
+            break;
+        case 'v':
+            verify = true;
+            break;
+        case 'D':
+            divided = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    vector<Position> positions;
+    if (!loadCorpus(path, positions)) {
+        return 1;
+    }
+
+    int failures = 0;
+    long totalLeaves = 0;
+    long totalTime = 0;
+    for (unsigned i = 0; i < positions.size(); i++) {
+        Position& position = positions[i];
+        if (optind < argc && find(argv + optind, argv + argc, position.name) == argv + argc) {
+            continue;
+        }
+        cout << position.name << endl;
+        int depthLimit = maxDepth > 0 ? maxDepth : (int) position.perft.size() - 1;
+        for (int depth = 1; depth <= depthLimit; depth++) {
+            State state = position.state;
+            long start = micros();
+            long leaves = perft(state, 0, depth, verify);
+            long elapsed = micros() - start;
+            totalLeaves += leaves;
+            totalTime += elapsed;
+
+            cout << "  depth " << setw(2) << depth << setw(14) << leaves << setw(12) << elapsed / 1000.0 << "ms"
+                << setw(12) << long(leaves / max(1e-6, elapsed / 1e6)) << " leaves/s";
+            if (depth < (int) position.perft.size() && position.perft[depth] >= 0) {
+                bool ok = position.perft[depth] == leaves;
+                cout << (ok ? "  ok" : "  FAIL, expected ") ;
+                if (!ok) {
+                    cout << position.perft[depth];
+                    failures++;
+                }
+            }
+            cout << endl;
+            if (divided) {
+                divide(state, depth, verify);
+            }
+        }
+    }
+    cout << totalLeaves << " leaves in " << totalTime / 1000.0 << "ms, "
+        << long(totalLeaves / max(1e-6, totalTime / 1e6)) << " leaves/s" << endl;
+    if (failures) {
+        cout << failures << " counts differ" << endl;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include <set>
+#include "tron.cc"
+#include "tron_util.cc"
+#include "tron_game.cc"
+
+// Pocket table builder. A pocket is the free space which only one player can reach; when it is
+// small, the player's score is exactly the longest path it can fill from its head, which the
+// evaluation's rooms only estimate. Every pocket of up to -c cells is enumerated, in each of
+// its orientations only once, and the bigger pockets, up to POCKET_CELLS, which arise in the
+// later turns of self-play games are added. Each pocket's fill is found by trying every path,
+// and the table is written for the bot's -f option.
+
+class PocketTableBuilder {
+private:
+    static const int SIZE = 2 * POCKET_CELLS + 3;
+    static const int CENTRE = POCKET_CELLS + 1;
+
+    set<uint64_t> keys;
+    // cells which are in the pocket, or have been offered to it, in the enumeration
+    bool seen[SIZE][SIZE];
+    Pocket pocket;
+    int maxCells;
+
+    // Redelmeier's enumeration of the connected sets of cells around the head: each cell in
+    // turn joins the pocket, and its neighbours which have not been considered yet may follow
+    void grow(vector<pair<int, int> > untried) {
+        while (!untried.empty()) {
+            int x = untried.back().first;
+            int y = untried.back().second;
+            untried.pop_back();
+            pocket.add(x - CENTRE, y - CENTRE);
+            add(pocket);
+            if (pocket.size < maxCells) {
+                vector<pair<int, int> > next = untried;
+                for (int i = 0; i < 4; i++) {
+                    int xx = x + xOffsets[i];
+                    int yy = y + yOffsets[i];
+                    if (!seen[xx][yy]) {
+                        seen[xx][yy] = true;
+                        next.push_back(make_pair(xx, yy));
+                    }
+                }
+                grow(next);
+                for (unsigned i = untried.size(); i < next.size(); i++) {
+                    seen[next[i].first][next[i].second] = false;
+                }
+            }
+            pocket.size--;
+        }
+    }
+
+public:
+    vector<PocketEntry> entries;
+    long harvested;
+
+    PocketTableBuilder() {
+        harvested = 0;
+    }
+
+    bool add(const Pocket& p) {
+        uint64_t key = p.key();
+        if (!keys.insert(key).second) {
+            return false;
+        }
+        PocketEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.key = key;
+        entry.fill = longestFill(p);
+        entries.push_back(entry);
+        return true;
+    }
+
+    void enumerate(int cells) {
+        maxCells = min(cells, POCKET_CELLS);
+        memset(seen, 0, sizeof(seen));
+        seen[CENTRE][CENTRE] = true;
+        vector<pair<int, int> > untried;
+        for (int i = 0; i < 4; i++) {
+            seen[CENTRE + xOffsets[i]][CENTRE + yOffsets[i]] = true;
+            untried.push_back(make_pair(CENTRE + xOffsets[i], CENTRE + yOffsets[i]));
+        }
+        pocket.size = 0;
+        add(pocket);
+        grow(untried);
+    }
+
+    // The pockets of every player in every position of self-play games from random starts
+    void harvest(const vector<int>& playerCounts, long games, unsigned seed) {
+        vector<Engine> engines(1);
+        engines[0].timeLimit = 0;
+        engines[0].nodeLimit = 500;
+        int seats[PLAYERS] = {0};
+        Voronoi* voronoi = new Voronoi();
+        for (long game = 0; game < games; game++) {
+            int numPlayers = playerCounts[game % playerCounts.size()];
+            int starts[PLAYERS][2];
+            randomStarts(numPlayers, rand_r(&seed), starts);
+            GameResult result;
+            vector<State> positions;
+            playGame(engines, numPlayers, seats, starts, 0, result, 0, &positions);
+            for (unsigned i = 0; i < positions.size(); i++) {
+                voronoi->flood(positions[i], 0);
+                for (int player = 0; player < numPlayers; player++) {
+                    Pocket found;
+                    if (voronoi->findPocket(positions[i], player, found) && add(found)) {
+                        harvested++;
+                    }
+                }
+            }
+        }
+        delete voronoi;
+    }
+};
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-c cells] [-n games] [-p players]... [-s seed] [-o pockets]" << endl;
+    cerr << "  -c  enumerate every pocket of up to this many cells (default 10)" << endl;
+    cerr << "  -n  self-play games from which to add bigger pockets, up to " << POCKET_CELLS << " cells" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    int cells = 10;
+    long games = 100;
+    vector<int> playerCounts;
+    unsigned seed = 1;
+    const char* outputPath = "pockets.bin";
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:p:s:o:")) != -1) {
+        switch (opt) {
+        case 'c':
+            cells = max(0, atoi(optarg));
+            break;
+        case 'n':
+            games = atol(optarg);
+            break;
+        case 'p':
+            playerCounts.push_back(min(PLAYERS, max(2, atoi(optarg))));
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (playerCounts.empty()) {
+        for (int players = 2; players <= PLAYERS; players++) {
+            playerCounts.push_back(players);
+        }
+    }
+
+    PocketTableBuilder builder;
+    long start = micros();
+    builder.enumerate(cells);
+    cerr << builder.entries.size() << " pockets of up to " << cells << " cells in " << fixed << setprecision(1)
+        << (micros() - start) / 1e6 << "s" << endl;
+    start = micros();
+    builder.harvest(playerCounts, games, seed);
+    cerr << builder.harvested << " more from " << games << " games in " << (micros() - start) / 1e6 << "s" << endl;
+
+    if (!writeTable(outputPath, builder.entries)) {
+        cerr << "Cannot write " << outputPath << endl;
+        return 1;
+    }
+    cerr << builder.entries.size() << " entries written to " << outputPath << endl;
+    return 0;
+}
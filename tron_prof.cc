@@ -1,12 +1,19 @@
 #include <algorithm>
 #include <fstream>
+#include <map>
 #include "tron.cc"
+#include "tron_util.cc"
 
-long timedSearch(State& s, bool pruningEnabled) {
+// Profiling harness. Each scenario is a fixed search workload (a board, player count and depth)
+// which is timed over several passes. Results can be saved as a baseline and later runs compared
+// against it: a scenario which is significantly slower than the baseline by more than the
+// threshold makes the run fail. Where the kernel allows it, hardware performance counters are
+// read around each pass and reported per node and per leaf evaluation.
+
+long timedSearch(State& s) {
     State state = s;
-    state.pruningEnabled = pruningEnabled;
 
-    Voronoi voronoi;
+    static Voronoi voronoi;
     Bounds bounds;
 
     Scores scores;
@@ -14,61 +21,295 @@ long timedSearch(State& s, bool pruningEnabled) {
     return state.nodesSearched;
 }
 
-void randomlyPopulate(State& state) {
-    int count = 10 + rand() % 5;
-    for (int i = 0; i < count; i++) {
-        int x = rand() % MAX_X;
-        int y = rand() % MAX_Y;
-        int size = rand() % 10;
-        if (rand() % 2 == 0) {
-            for (int yy = y; yy <= MAX_Y && yy - y <= size; yy++) {
-                state.occupy(x, yy, 0);
-            }
-        } else {
-            for (int xx = x; xx <= MAX_X && xx - x <= size; xx++) {
-                state.occupy(xx, y, 0);
+// The original profiling board
+void classicBoard(State& state) {
+    srand(199);
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+    state.timeLimitEnabled = false;
+
+    randomlyPopulate(state, 10 + rand() % 5);
+    state.occupy(26, 18, 0);
+    state.occupy(16, 1, 1);
+}
+
+class Scenario {
+public:
+    string name;
+    State state;
+    int loops;
+
+    Scenario(const string& p_name, const State& p_state, int depth) : name(p_name), state(p_state), loops(0) {
+        state.maxDepth = depth;
+        state.pruningEnabled = false;
+        state.timeLimitEnabled = false;
+    }
+};
+
+class Result {
+public:
+    int passes;
+    double mean;     // ms per search
+    double stddev;
+    double median;
+    double ci;
+    long nodes;      // nodes per search
+    long leaves;     // leaf evaluations per search
+    double counters[PERF_COUNTERS];  // per search, or -1 if unavailable
+
+    Result() {
+        passes = 0;
+        mean = stddev = median = ci = 0;
+        nodes = leaves = 0;
+        fill(counters, counters + PERF_COUNTERS, -1.0);
+    }
+};
+
+void buildScenarios(vector<Scenario>& scenarios, const vector<int>& depths, bool pruningEnabled) {
+    State classic;
+    classicBoard(classic);
+    scenarios.push_back(Scenario("classic-d8", classic, 8));
+
+    for (int players = 2; players <= PLAYERS; players++) {
+        for (int density = 0; density < DENSITIES; density++) {
+            State state;
+            benchmarkBoard(state, players, density, 199);
+            for (unsigned i = 0; i < depths.size(); i++) {
+                ostringstream name;
+                name << players << "p-" << densityNames[density] << "-d" << depths[i];
+                scenarios.push_back(Scenario(name.str(), state, depths[i]));
             }
         }
     }
+    for (unsigned i = 0; i < scenarios.size(); i++) {
+        scenarios[i].state.pruningEnabled = pruningEnabled;
+    }
 }
 
-int main(int argc, char* argv[]) {
-    ofstream os("timing.log");
-    os << "Nodes,Time,NodesPer100ms" << endl;
+// Choose a loop count so that one pass takes roughly the given time
+void calibrate(Scenario& scenario, long passMillis) {
+    long start = micros();
+    timedSearch(scenario.state);
+    long elapsed = max(1L, micros() - start);
+    scenario.loops = max(1L, passMillis * 1000 / elapsed);
+}
+
+Result profile(Scenario& scenario, int passes, PerfCounters& perf, ostream& log) {
+    vector<double> times;
+    long nodes = 0;
+    long totals[PERF_COUNTERS] = {0};
+    for (int j = 0; j < passes; j++) {
+        nodes = 0;
+        long start = micros();
+        perf.start();
+        for (int i = 0; i < scenario.loops; i++) {
+            nodes += timedSearch(scenario.state);
+        }
+        perf.stop();
+        long elapsed = micros() - start;
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            totals[k] = perf.values[k] < 0 || totals[k] < 0 ? -1 : totals[k] + perf.values[k];
+        }
+        times.push_back(elapsed / 1000.0 / scenario.loops);
+        log << scenario.name << "," << nodes << "," << elapsed / 1000 << "," << 100000.0 * nodes / max(1L, elapsed) << endl;
+    }
 
+    Stats stats(times);
+    Result result;
+    result.passes = passes;
+    result.mean = stats.mean;
+    result.stddev = stats.stddev;
+    result.median = stats.median;
+    result.ci = confidence(stats);
+    result.nodes = nodes / scenario.loops;
+    result.leaves = countLeaves(scenario.state);
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        result.counters[k] = totals[k] < 0 ? -1 : double(totals[k]) / passes / scenario.loops;
+    }
+    return result;
+}
+
+bool readBaseline(const char* path, map<string, Result>& baseline) {
+    ifstream is(path);
+    if (!is) {
+        cerr << "Cannot open baseline " << path << endl;
+        return false;
+    }
+    string line;
+    getline(is, line);
+    while (getline(is, line)) {
+        replace(line.begin(), line.end(), ',', ' ');
+        istringstream ls(line);
+        string name;
+        Result r;
+        if (ls >> name >> r.passes >> r.mean >> r.stddev >> r.median >> r.ci >> r.nodes) {
+            baseline[name] = r;
+        }
+    }
+    return true;
+}
+
+void writeBaseline(ostream& os, const string& name, const Result& r) {
+    os << name << "," << r.passes << "," << r.mean << "," << r.stddev << "," << r.median << "," << r.ci << ","
+        << r.nodes << "," << r.leaves;
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        os << "," << r.counters[k];
+    }
+    os << endl;
+}
+
+// Print the counters for one search divided by the given count
+void printCounters(const Result& r, long per, const char* unit) {
+    cout << "    per " << setw(5) << left << unit << right << setprecision(1);
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        if (r.counters[k] >= 0) {
+            cout << setw(10) << r.counters[k] / max(1L, per) << " " << perfCounterNames[k] << ",";
+        }
+    }
+    if (r.counters[PERF_CYCLES] > 0 && r.counters[PERF_INSTRUCTIONS] >= 0) {
+        cout << setprecision(2) << " IPC " << r.counters[PERF_INSTRUCTIONS] / r.counters[PERF_CYCLES];
+    }
+    cout << endl;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-q] [-P] [-p passes] [-m pass_ms] [-d depth]... [-b baseline.csv] [-s save.csv]"
+        << " [-t threshold%] [-C] [-n nodes] [filter]" << endl;
+    cerr << "  -C  do not read hardware performance counters" << endl;
+    cerr << "  -n  stop each search after this many nodes, so that builds whose searches differ do the same work"
+        << endl;
+}
+
+int main(int argc, char* argv[]) {
     int passes = 10;
-    int loops = 1000;
-    if (argc > 1) {
-        passes = 1;
-        loops = 50;
+    long passMillis = 500;
+    vector<int> depths;
+    const char* baselinePath = 0;
+    const char* savePath = 0;
+    double threshold = 5;
+    bool pruningEnabled = false;
+    bool countersEnabled = true;
+    int nodeLimit = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "qPp:m:d:b:s:t:Cn:")) != -1) {
+        switch (opt) {
+        case 'q':
+            passes = 3;
+            passMillis = 50;
+            break;
+        case 'P':
+            pruningEnabled = true;
+            break;
+        case 'p':
+            passes = atoi(optarg);
+            break;
+        case 'm':
+            passMillis = atol(optarg);
+            break;
+        case 'd':
+            depths.push_back(atoi(optarg));
+            break;
+        case 'b':
+            baselinePath = optarg;
+            break;
+        case 's':
+            savePath = optarg;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 'C':
+            countersEnabled = false;
+            break;
+        case 'n':
+            nodeLimit = max(0, atoi(optarg));
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    string filter = optind < argc ? argv[optind] : "";
+    if (depths.empty()) {
+        depths.push_back(6);
+        depths.push_back(8);
     }
 
-    for (int j = 0; j < passes; j++) {
-        srand(199);
-        // srand(time(0));
+    map<string, Result> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline)) {
+        return 1;
+    }
 
-        State state;
-        state.numPlayers = 2;
-        state.thisPlayer = 0;
-        state.maxDepth = 8;
-        state.pruningEnabled = false;
-        state.timeLimitEnabled = false;
+    vector<Scenario> scenarios;
+    buildScenarios(scenarios, depths, pruningEnabled);
+    for (unsigned i = 0; i < scenarios.size(); i++) {
+        scenarios[i].state.setNodeBudget(nodeLimit);
+    }
+
+    ofstream os("timing.log");
+    os << "Scenario,Nodes,Time,NodesPer100ms" << endl;
+    ofstream save;
+    if (savePath) {
+        save.open(savePath);
+        save << "scenario,passes,mean_ms,stddev_ms,median_ms,ci95_ms,nodes,leaves";
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            save << "," << perfCounterNames[k];
+        }
+        save << endl;
+    }
 
-        randomlyPopulate(state);
-        state.occupy(26, 18, 0);
-        state.occupy(16, 1, 1);
+    PerfCounters perf;
+    if (!countersEnabled) {
+        perf.disable();
+    } else if (!perf.available()) {
+        cerr << "Hardware counters unavailable (" << perf.error << "), reporting times only" << endl;
+    }
 
-        long nodes = 0;
-        clock_t start = millis();
+    cout << left << setw(18) << "scenario" << right << setw(10) << "nodes" << setw(12) << "mean ms"
+        << setw(12) << "median ms" << setw(12) << "95% ci" << setw(12) << "knodes/s";
+    if (baselinePath) {
+        cout << setw(12) << "base ms" << setw(10) << "speedup";
+    }
+    cout << endl;
 
-        for (int i = 0; i < loops; i++) {
-            nodes += timedSearch(state, true);
+    bool regressed = false;
+    for (unsigned i = 0; i < scenarios.size(); i++) {
+        Scenario& scenario = scenarios[i];
+        if (scenario.name.find(filter) == string::npos) {
+            continue;
+        }
+        calibrate(scenario, passMillis);
+        Result r = profile(scenario, passes, perf, os);
+        if (savePath) {
+            writeBaseline(save, scenario.name, r);
         }
 
-        clock_t elapsed = millis() - start;
-        os << nodes << "," << elapsed << "," << 100.0 * nodes / elapsed << endl;
-        cerr << "Pass " << j << " complete" << endl;
+        cout << left << setw(18) << scenario.name << right << fixed << setprecision(3) << setw(10) << r.nodes
+            << setw(12) << r.mean << setw(12) << r.median << setw(9) << "+-" << r.ci
+            << setw(12) << setprecision(1) << r.nodes / r.mean;
+        map<string, Result>::const_iterator b = baseline.find(scenario.name);
+        if (b != baseline.end()) {
+            const Result& base = b->second;
+            double speedup = base.mean / r.mean;
+            bool significant = significantlyDifferent(r.mean, r.stddev, r.passes, base.mean, base.stddev, base.passes);
+            bool slower = significant && r.mean > base.mean * (1 + threshold / 100);
+            cout << setprecision(3) << setw(12) << base.mean << setw(9) << speedup << "x"
+                << (significant ? (speedup > 1 ? " faster" : " slower") : "") << (slower ? " REGRESSION" : "");
+            if (base.nodes != r.nodes) {
+                cout << " (nodes " << base.nodes << " -> " << r.nodes << ")";
+            }
+            regressed = regressed || slower;
+        } else if (baselinePath) {
+            cout << setw(12) << "-";
+        }
+        cout << endl;
+        if (perf.available()) {
+            printCounters(r, r.nodes, "node");
+            printCounters(r, r.leaves, "leaf");
+        }
+        cerr << "Scenario " << scenario.name << " complete" << endl;
     }
 
     os.close();
+    return regressed ? 2 : 0;
 }
@@ -0,0 +1,246 @@
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "tron.cc"
+
+// A game within a mapped record file
+struct Game {
+    const TurnRecord* records;
+    int turns;
+};
+
+class ReplaySettings {
+public:
+    int maxDepth;
+    bool pruningEnabled;
+    int pruneMargin;
+    bool timeLimitEnabled;
+    FILE* traceFile;    // trace each search here, if set
+
+    ReplaySettings() {
+        maxDepth = -1;
+        pruningEnabled = false;
+        pruneMargin = 0;
+        timeLimitEnabled = false;
+        traceFile = 0;
+    }
+
+    void apply(State& state, const TurnRecord& record) const {
+        state.maxDepth = maxDepth > 0 ? maxDepth : record.maxDepth;
+        state.pruningEnabled = pruningEnabled;
+        state.pruneMargin = pruneMargin;
+        state.timeLimitEnabled = timeLimitEnabled;
+    }
+};
+
+bool mapGames(const char* path, vector<Game>& games) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot open " << path << endl;
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    const char* data = (const char*) mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        cerr << "Cannot map " << path << endl;
+        return false;
+    }
+
+    long blocks = st.st_size / sizeof(TurnRecord);
+    for (long i = 0; i < blocks; i++) {
+        const char* block = data + i * sizeof(TurnRecord);
+        if (isLogHeader(block)) {
+            const LogHeader* header = (const LogHeader*) block;
+            if (header->version != LOG_VERSION || header->recordSize != sizeof(TurnRecord)
+                    || header->players != PLAYERS || header->width != WIDTH || header->height != HEIGHT) {
+                cerr << "Incompatible game record at block " << i << endl;
+                return false;
+            }
+            Game game;
+            game.records = (const TurnRecord*) (block + sizeof(TurnRecord));
+            game.turns = 0;
+            games.push_back(game);
+        } else if (games.empty()) {
+            cerr << "Missing header in " << path << endl;
+            return false;
+        } else {
+            games.back().turns++;
+        }
+    }
+    return true;
+}
+
+void printRecord(int turn, const TurnRecord& record) {
+    cout << setw(4) << turn << "  p" << int(record.thisPlayer) << "  " << setw(5) << moveName(record.move)
+        << "  max depth " << int(record.maxDepth) << "  " << setw(8) << record.nodes << " nodes  "
+        << setw(6) << record.elapsed / 1000.0 << "ms" << (record.timeout ? " (timeout)" : "") << "  scores";
+    for (int i = 0; i < record.numPlayers; i++) {
+        cout << " " << record.scores[i];
+    }
+    cout << endl;
+}
+
+// Rebuild the bot's view of the board as it was at the given turn
+void rebuildState(const Game& game, int turn, State& state) {
+    TurnInput input;
+    for (int i = 0; i <= turn; i++) {
+        game.records[i].get(input);
+        state.applyTurn(input);
+    }
+}
+
+// Search a turn again, returning true if the move is unchanged
+bool research(const Game& game, int turn, const ReplaySettings& settings, bool verbose, long& nodes, long& elapsed) {
+    State state;
+    rebuildState(game, turn, state);
+    const TurnRecord& record = game.records[turn];
+    settings.apply(state, record);
+
+    Scores scores;
+    Bounds bounds;
+    static Voronoi voronoi;
+    tracer = settings.traceFile ? new Tracer(20) : 0;
+    state.resetTimer();
+    long start = micros();
+    minimax(scores, bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+    elapsed = micros() - start;
+    nodes = state.nodesSearched;
+    if (tracer) {
+        tracer->write(settings.traceFile, turn, state.numPlayers, state.thisPlayer, state.maxDepth);
+        delete tracer;
+        tracer = 0;
+    }
+
+    bool same = moveIndex(scores.move) == record.move;
+    if (verbose || !same) {
+        cout << setw(4) << turn << "  p" << int(record.thisPlayer) << "  " << setw(5) << moveName(record.move)
+            << " -> " << setw(5) << scores.move << "  " << setw(8) << record.nodes << " -> " << setw(8) << nodes
+            << " nodes  " << setw(6) << record.elapsed / 1000.0 << " -> " << setw(6) << elapsed / 1000.0 << "ms"
+            << (same ? "" : "  CHANGED") << endl;
+    }
+    if (verbose) {
+        state.print();
+        cerr << "Logged: ";
+        for (int i = 0; i < record.numPlayers; i++) {
+            cerr << record.scores[i] << " / ";
+        }
+        cerr << moveName(record.move) << endl << "Now:    ";
+        scores.print();
+    }
+    return same;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-g game] [-t turn | -a] [-d depth] [-p] [-m margin] [-T] [-x tracefile] gamelog" << endl;
+    cerr << "  -g  select a game within the file (default: all games)" << endl;
+    cerr << "  -t  search one turn again and show the board" << endl;
+    cerr << "  -a  search every turn again and report changed moves" << endl;
+    cerr << "  -d  search depth (default: depth recorded for the turn)" << endl;
+    cerr << "  -p  enable pruning, with optional margin -m" << endl;
+    cerr << "  -T  enable the time limit (default: search to full depth)" << endl;
+    cerr << "  -x  append a trace of each search here, for tron_trace" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    ReplaySettings settings;
+    int gameIndex = -1;
+    int turn = -1;
+    bool all = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "g:t:ad:pm:Tx:")) != -1) {
+        switch (opt) {
+        case 'g':
+            gameIndex = atoi(optarg);
+            break;
+        case 't':
+            turn = atoi(optarg);
+            break;
+        case 'a':
+            all = true;
+            break;
+        case 'd':
+            settings.maxDepth = atoi(optarg);
+            break;
+        case 'p':
+            settings.pruningEnabled = true;
+            break;
+        case 'm':
+            settings.pruneMargin = atoi(optarg);
+            break;
+        case 'T':
+            settings.timeLimitEnabled = true;
+            break;
+        case 'x':
+            settings.traceFile = fopen(optarg, "ab");
+            if (!settings.traceFile) {
+                cerr << "Cannot open trace file " << optarg << endl;
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<Game> games;
+    if (!mapGames(argv[optind], games)) {
+        return 1;
+    }
+
+    int changed = 0;
+    int searched = 0;
+    long oldNodes = 0, newNodes = 0, oldTime = 0, newTime = 0;
+
+    for (int g = 0; g < (int) games.size(); g++) {
+        if (gameIndex >= 0 && g != gameIndex) {
+            continue;
+        }
+        const Game& game = games[g];
+        cout << "Game " << g << ": " << game.turns << " turns" << endl;
+
+        if (turn >= 0) {
+            if (turn >= game.turns) {
+                cerr << "Game " << g << " has no turn " << turn << endl;
+                continue;
+            }
+            long nodes, elapsed;
+            research(game, turn, settings, true, nodes, elapsed);
+        } else if (all) {
+            for (int t = 0; t < game.turns; t++) {
+                long nodes, elapsed;
+                if (!research(game, t, settings, false, nodes, elapsed)) {
+                    changed++;
+                }
+                searched++;
+                oldNodes += game.records[t].nodes;
+                oldTime += game.records[t].elapsed;
+                newNodes += nodes;
+                newTime += elapsed;
+            }
+        } else {
+            for (int t = 0; t < game.turns; t++) {
+                printRecord(t, game.records[t]);
+            }
+        }
+    }
+
+    if (all && searched > 0) {
+        cout << searched << " turns, " << changed << " changed moves" << endl;
+        cout << "Nodes: " << oldNodes << " -> " << newNodes << endl;
+        cout << "Time:  " << oldTime / 1000.0 << "ms -> " << newTime / 1000.0 << "ms" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+#include "tron.cc"
+#include "tron_util.cc"
+
+// Scaling benchmark over board sizes. Each board gets a reproducible random position, with walls
+// in proportion to its area, which is evaluated repeatedly to find the cost of one evaluation, and
+// then searched with iterative deepening to find the depth reachable within a move's time. The
+// board dimensions are compile time parameters, so each size is its own build of the state, the
+// evaluation and the search.
+//
+// With -P the board is the standard one and the number of players grows instead, up to 16, to
+// compare the cost of minimax, which weighs every player's rank and score, with paranoid search.
+
+class Options {
+public:
+    int players;
+    int density;
+    long timeLimit;     // ms per move
+    long sampleNanos;
+    int maxDepth;
+    int fixedDepth;
+    bool byPlayers;
+    string filter;
+
+    Options() {
+        players = 2;
+        density = 1;
+        timeLimit = TIME_LIMIT;
+        sampleNanos = 200000000L;
+        maxDepth = 30;
+        fixedDepth = 4;
+        byPlayers = false;
+    }
+};
+
+template <int width, int height>
+void scale(const Options& options) {
+    typedef BoardSize<width, height> Board;
+    ostringstream name;
+    name << width << "x" << height;
+    if (name.str().find(options.filter) == string::npos) {
+        return;
+    }
+
+    BasicState<Board> state;
+    benchmarkBoard(state, options.players, options.density, 199);
+    int freeCells = 0;
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            freeCells += !state.occupied(x, y);
+        }
+    }
+    // too big for the stack on large boards
+    BasicVoronoi<StandardEval, Board>* voronoi = new BasicVoronoi<StandardEval, Board>();
+
+    Scores scores;
+    long evaluations = 0;
+    long start = nanos();
+    long elapsed;
+    do {
+        calculateScores(scores, *voronoi, state, evaluations % options.players);
+        evaluations++;
+        elapsed = nanos() - start;
+    } while (elapsed < options.sampleNanos);
+    double evalNanos = double(elapsed) / evaluations;
+
+    // Deepen until the searches so far have used up a move's time
+    int depth = 0;
+    long nodes = 0;
+    long spent = 0;
+    for (int d = 1; d <= options.maxDepth; d++) {
+        BasicState<Board> search = state;
+        search.maxDepth = d;
+        search.timeLimitEnabled = false;
+        Bounds bounds;
+        long searchStart = micros();
+        minimax(scores, bounds, search, 0, (void*) policyRecursive<StandardEval, Board>, voronoi);
+        spent += micros() - searchStart;
+        if (spent > options.timeLimit * 1000) {
+            break;
+        }
+        depth = d;
+        nodes = search.nodesSearched;
+    }
+
+    cout << left << setw(10) << name.str() << right << setw(8) << Board::area << setw(8) << freeCells << fixed
+        << setprecision(1) << setw(12) << evalNanos / 1000 << setw(12) << evalNanos / freeCells
+        << setw(8) << depth << setw(10) << nodes
+        << setw(12) << (sizeof(BasicVoronoi<StandardEval, Board>) + 1023) / 1024
+        << setw(10) << (sizeof(BasicState<Board>) + 1023) / 1024 << endl;
+    delete voronoi;
+}
+
+// Search to a depth with minimax or paranoid search, returning microseconds and nodes
+template <class Board>
+long timedSearch(const BasicState<Board>& s, BasicVoronoi<StandardEval, Board>& voronoi, int depth, bool paranoidSearch,
+        long& nodes) {
+    BasicState<Board> state = s;
+    state.maxDepth = depth;
+    state.timeLimitEnabled = false;
+    BasicScores<Board::players> scores;
+    BasicBounds<Board::players> bounds;
+    long start = micros();
+    if (paranoidSearch) {
+        paranoid(scores, INT_MIN, INT_MAX, state, 0, voronoi);
+    } else {
+        minimax(scores, bounds, state, 0, (void*) policyRecursive<StandardEval, Board>, &voronoi);
+    }
+    nodes = state.nodesSearched;
+    return micros() - start;
+}
+
+// The cost of each search at a fixed depth, and the depth each reaches within a move's time, as the
+// number of players on the standard board grows
+void scalePlayers(const Options& options) {
+    typedef BoardSize<WIDTH, HEIGHT, 16> Board;
+    BasicVoronoi<StandardEval, Board>* voronoi = new BasicVoronoi<StandardEval, Board>();
+    cout << densityNames[options.density] << " walls, depth " << options.fixedDepth << ", " << options.timeLimit
+        << "ms per move" << endl;
+    cout << left << setw(8) << "players" << setw(10) << "search" << right << setw(10) << "eval us" << setw(10)
+        << "nodes" << setw(12) << "ms" << setw(12) << "us/node" << setw(8) << "depth" << endl;
+    const int playerCounts[] = {2, 4, 8, 16};
+    for (int p = 0; p < 4; p++) {
+        int players = playerCounts[p];
+        BasicState<Board> state;
+        benchmarkBoard(state, players, options.density, 199);
+
+        BasicScores<Board::players> scores;
+        long evaluations = 0;
+        long start = nanos();
+        long elapsed;
+        do {
+            calculateScores(scores, *voronoi, state, evaluations % players);
+            evaluations++;
+            elapsed = nanos() - start;
+        } while (elapsed < options.sampleNanos);
+
+        for (int search = 0; search < 2; search++) {
+            long nodes;
+            long time = timedSearch(state, *voronoi, options.fixedDepth, search, nodes);
+            int depth = 0;
+            long spent = 0;
+            for (int d = 1; d <= options.maxDepth; d++) {
+                long ignored;
+                spent += timedSearch(state, *voronoi, d, search, ignored);
+                if (spent > options.timeLimit * 1000) {
+                    break;
+                }
+                depth = d;
+            }
+            cout << left << setw(8) << players << setw(10) << (search ? "paranoid" : "minimax") << right << fixed
+                << setprecision(1) << setw(10) << elapsed / 1000.0 / evaluations << setw(10) << nodes
+                << setprecision(3) << setw(12) << time / 1000.0 << setw(12) << double(time) / max(1L, nodes)
+                << setw(8) << depth << endl;
+        }
+    }
+    delete voronoi;
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-P] [-p players] [-d density] [-t move_ms] [-s sample_ms] [-D max_depth]"
+        << " [-f fixed_depth] [filter]" << endl;
+    cerr << "  -P  scale the number of players (up to 16) instead of the board" << endl;
+    cerr << "  -d  wall density: 0 sparse, 1 medium, 2 dense" << endl;
+    cerr << "  -f  depth at which to compare the searches, with -P" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "Pp:d:t:s:D:f:")) != -1) {
+        switch (opt) {
+        case 'P':
+            options.byPlayers = true;
+            break;
+        case 'p':
+            options.players = min(PLAYERS, max(2, atoi(optarg)));
+            break;
+        case 'd':
+            options.density = min(DENSITIES - 1, max(0, atoi(optarg)));
+            break;
+        case 't':
+            options.timeLimit = atol(optarg);
+            break;
+        case 's':
+            options.sampleNanos = atol(optarg) * 1000000L;
+            break;
+        case 'D':
+            options.maxDepth = atoi(optarg);
+            break;
+        case 'f':
+            options.fixedDepth = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        options.filter = argv[optind];
+    }
+    if (options.byPlayers) {
+        scalePlayers(options);
+        return 0;
+    }
+
+    cout << options.players << " players, " << densityNames[options.density] << " walls, " << options.timeLimit
+        << "ms per move" << endl;
+    cout << left << setw(10) << "board" << right << setw(8) << "area" << setw(8) << "free" << setw(12) << "eval us"
+        << setw(12) << "ns/cell" << setw(8) << "depth" << setw(10) << "nodes" << setw(12) << "voronoi KB"
+        << setw(10) << "state KB" << endl;
+    scale<WIDTH, HEIGHT>(options);
+    scale<50, 50>(options);
+    scale<100, 100>(options);
+    scale<150, 150>(options);
+    scale<200, 200>(options);
+    scale<250, 250>(options);
+    return 0;
+}
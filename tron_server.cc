@@ -0,0 +1,312 @@
+#include <cctype>
+#include <map>
+#include <poll.h>
+#include <queue>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "tron.cc"
+#include "tron_game.cc"
+
+// Game server. Each connection to a Unix domain socket is one game, speaking the bot's turn
+// protocol: the referee writes a turn, and the server replies with the move. One thread reads the
+// connections; every turn it completes is queued for a pool of search threads, earliest deadline
+// first, with a deadline of its arrival plus the engine's time per move. A search which starts
+// late has only what is left of the time, so an overloaded server plays shallower rather than
+// later. Each search thread keeps one evaluator for all the games it plays, so memory grows with
+// the threads and not the games: a game only holds its board.
+
+// One connection
+class Game {
+public:
+    int fd;
+    long id;
+    State state;
+    // input not yet parsed into a turn
+    string pending;
+    // a turn is queued or being searched; replies must go out in order, so the next waits
+    bool busy;
+    // no more turns will be played
+    bool closed;
+    // still polled by the reading thread
+    bool connected;
+    long turns;
+    long late;
+    long totalMillis;
+    long maxMillis;
+
+    Game(int p_fd, long p_id) : fd(p_fd), id(p_id), busy(false), closed(false), connected(true) {
+        turns = late = totalMillis = maxMillis = 0;
+    }
+};
+
+class Job {
+public:
+    Game* game;
+    TurnInput input;
+    long arrival;     // ms
+    long deadline;
+
+    bool operator<(const Job& other) const {
+        // priority_queue pops the largest, so the earliest deadline must compare greatest
+        return deadline > other.deadline;
+    }
+};
+
+// Take one whole turn off the front of the input, if there is one. A turn is the player count and
+// our number followed by four coordinates per player, so it is complete once that many numbers
+// have each been followed by whitespace.
+bool takeTurn(string& pending, TurnInput& input) {
+    vector<long> numbers;
+    const char* start = pending.c_str();
+    const char* p = start;
+    while (true) {
+        while (*p && isspace(*p)) {
+            p++;
+        }
+        char* end;
+        long n = strtol(p, &end, 10);
+        if (end == p || !*end) {
+            // no number, or one which may not have arrived in full
+            return false;
+        }
+        numbers.push_back(n);
+        p = end;
+        if (numbers.size() == 2 && (numbers[0] < 1 || numbers[0] > PLAYERS || numbers[1] < 0
+                || numbers[1] >= numbers[0])) {
+            cerr << "Bad turn: " << numbers[0] << " players, we are " << numbers[1] << endl;
+            pending.clear();
+            return false;
+        }
+        if (numbers.size() >= 2 && (long) numbers.size() == 2 + 4 * numbers[0]) {
+            break;
+        }
+    }
+    input.numPlayers = numbers[0];
+    input.thisPlayer = numbers[1];
+    for (int i = 0; i < input.numPlayers; i++) {
+        for (int j = 0; j < 4; j++) {
+            input.coords[i][j] = numbers[2 + i * 4 + j];
+        }
+    }
+    pending.erase(0, p - start);
+    return true;
+}
+
+class Server {
+private:
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    priority_queue<Job> jobs;
+    map<int, Game*> games;
+    long nextId;
+    long served;
+    long lateTurns;
+
+    // Queue the next turn of an idle game, if it has one. Called with the lock held.
+    void schedule(Game* game) {
+        Job job;
+        if (game->busy || game->closed || !takeTurn(game->pending, job.input)) {
+            return;
+        }
+        job.game = game;
+        job.arrival = millis();
+        job.deadline = job.arrival + engine.timeLimit;
+        game->busy = true;
+        jobs.push(job);
+        pthread_cond_signal(&ready);
+    }
+
+    // Forget a game once neither the reading thread nor a search holds it. Called with the lock held.
+    void release(Game* game) {
+        if (!game->connected && !game->busy) {
+            cerr << "game " << game->id << " over: " << game->turns << " turns, " << fixed << setprecision(1)
+                << double(game->totalMillis) / max(1L, game->turns) << "ms mean, " << game->maxMillis
+                << "ms max, " << game->late << " late; " << served << " turns served, " << lateTurns << " late"
+                << endl;
+            close(game->fd);
+            delete game;
+        }
+    }
+
+    void search(Job& job, void* evaluator) {
+        Game& game = *job.game;
+        State& state = game.state;
+        state.applyTurn(job.input);
+        engine.configure(state);
+        // the deadline runs on the wall clock from the turn's arrival, however long it queued
+        state.clock = millis;
+        state.timeLimitEnabled = engine.timeLimit > 0;
+        state.startTime = job.arrival;
+        state.timeLimitReached = false;
+
+        Scores scores;
+        Bounds bounds;
+        const EvalVariant* variant = engine.variant;
+        variant->search(scores, bounds, state, 0, (void*) variant->search, evaluator);
+
+        string reply = string(scores.move) + "\n";
+        bool sent = write(game.fd, reply.c_str(), reply.size()) == (ssize_t) reply.size();
+        long elapsed = millis() - job.arrival;
+
+        pthread_mutex_lock(&lock);
+        game.turns++;
+        game.totalMillis += elapsed;
+        game.maxMillis = max(game.maxMillis, elapsed);
+        if (engine.timeLimit > 0 && elapsed > engine.timeLimit + lateMargin) {
+            game.late++;
+            lateTurns++;
+        }
+        served++;
+        game.busy = false;
+        game.closed = game.closed || !sent;
+        schedule(&game);
+        release(&game);
+        pthread_mutex_unlock(&lock);
+    }
+
+    static void* worker(void* data) {
+        Server& server = *(Server*) data;
+        void* evaluator = server.engine.variant->create(server.engine.params);
+        while (true) {
+            pthread_mutex_lock(&server.lock);
+            while (server.jobs.empty()) {
+                pthread_cond_wait(&server.ready, &server.lock);
+            }
+            Job job = server.jobs.top();
+            server.jobs.pop();
+            pthread_mutex_unlock(&server.lock);
+            server.search(job, evaluator);
+        }
+        return 0;
+    }
+
+public:
+    Engine engine;
+    int threads;
+    long maxGames;
+    long lateMargin;  // ms over the time limit before a reply counts as late
+
+    Server() : nextId(0), served(0), lateTurns(0) {
+        pthread_mutex_init(&lock, 0);
+        pthread_cond_init(&ready, 0);
+        engine.name = "server";
+        threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+        maxGames = 1000;
+        lateMargin = 20;
+    }
+
+    int run(const char* path) {
+        signal(SIGPIPE, SIG_IGN);
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        unlink(path);
+        if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0
+                || listen(listener, 64) < 0) {
+            cerr << "Cannot listen on " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+
+        for (int i = 0; i < threads; i++) {
+            pthread_t thread;
+            pthread_create(&thread, 0, worker, this);
+            pthread_detach(thread);
+        }
+        cerr << engine.describe() << endl << "listening on " << path << " with " << threads << " threads" << endl;
+
+        vector<struct pollfd> fds;
+        char buffer[4096];
+        while (true) {
+            fds.clear();
+            struct pollfd listening = {listener, POLLIN, 0};
+            fds.push_back(listening);
+            pthread_mutex_lock(&lock);
+            for (map<int, Game*>::iterator i = games.begin(); i != games.end(); ++i) {
+                struct pollfd connection = {i->first, POLLIN, 0};
+                fds.push_back(connection);
+            }
+            pthread_mutex_unlock(&lock);
+
+            if (poll(&fds[0], fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                cerr << "poll: " << strerror(errno) << endl;
+                return 1;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listener, 0, 0);
+                if (fd >= 0) {
+                    pthread_mutex_lock(&lock);
+                    if ((long) games.size() >= maxGames) {
+                        close(fd);
+                    } else {
+                        games[fd] = new Game(fd, nextId++);
+                    }
+                    pthread_mutex_unlock(&lock);
+                }
+            }
+            for (unsigned i = 1; i < fds.size(); i++) {
+                if (!fds[i].revents) {
+                    continue;
+                }
+                ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+                pthread_mutex_lock(&lock);
+                Game* game = games[fds[i].fd];
+                if (n > 0) {
+                    game->pending.append(buffer, n);
+                    schedule(game);
+                } else {
+                    games.erase(fds[i].fd);
+                    game->closed = true;
+                    game->connected = false;
+                    release(game);
+                }
+                pthread_mutex_unlock(&lock);
+            }
+        }
+    }
+};
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-S socket] [-e name:key=value,...] [-j threads] [-g max_games] [-m late_ms]" << endl;
+    cerr << "  engine settings: depth, pruning (on/off), margin, selective, time (ms per move, from the turn's"
+        << " arrival), nodes, eval, params (file), or any evaluation parameter by name" << endl;
+    cerr << "  -m  ms over the time limit before a reply is reported as late" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = "/tmp/tron.sock";
+    Server server;
+    int opt;
+    while ((opt = getopt(argc, argv, "S:e:j:g:m:")) != -1) {
+        switch (opt) {
+        case 'S':
+            path = optarg;
+            break;
+        case 'e':
+            if (!server.engine.parse(optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            server.threads = max(1, atoi(optarg));
+            break;
+        case 'g':
+            server.maxGames = max(1, atoi(optarg));
+            break;
+        case 'm':
+            server.lateMargin = atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    return server.run(path);
+}
@@ -1,5 +1,7 @@
-//#define TRON_TRACE
+//#define TRON_DEBUG
 #include "tron.cc"
+#include "tron_util.cc"
+#include "tron_game.cc"
 
 #include "gtest/gtest.h"
 #include <fstream>
@@ -18,42 +20,6 @@ Scores calculateScores(Voronoi& voronoi, State& state, int turn = 0) {
     return scores;
 }
 
-void readBoard(State& state, istream& is) {
-    Player players[PLAYERS];
-    for (int i = 0; i < PLAYERS; i++) {
-        players[i].x = -1;
-    }
-    string line;
-    int y = 0;
-    while (getline(is, line)) {
-        for (unsigned x = 0; x < line.size(); x++) {
-            char cell = line[x];
-            int player = cell - '0';
-            if (player >= 0 && player < PLAYERS) {
-                state.occupy(x, y, player);
-            } else {
-                player = cell - 'A';
-                if (player >= 0 && player < PLAYERS) {
-                    players[player].x = x;
-                    players[player].y = y;
-                }
-            }
-        }
-        y++;
-    }
-    for (unsigned i = 0; i < PLAYERS; i++) {
-        if (players[i].x >= 0) {
-            state.occupy(players[i].x, players[i].y, i);
-            state.numPlayers = i + 1;
-        }
-    }
-}
-
-void readBoard(State& state, const char* board) {
-    istringstream is(board);
-    readBoard(state, is);
-}
-
 Scores scoreCalculator_MaximiseScore(Bounds& bounds, State& state, int turn, void* dummy, void* data) {
     Scores scores;
     scores.scores[1] = 1;
@@ -145,6 +111,29 @@ TEST(Voronoi, EmptyBoardEqualRegions) {
     // ASSERT_TRUE(voronoi.regionForPlayer(0) == voronoi.regionForPlayer(1));
 }
 
+template <int width, int height>
+void expectEqualRegions() {
+    typedef BoardSize<width, height> Board;
+    BasicState<Board> state;
+    state.numPlayers = 2;
+    state.occupy(5, height / 2, 0);
+    state.occupy(width - 6, height / 2, 1);
+
+    BasicVoronoi<StandardEval, Board>* voronoi = new BasicVoronoi<StandardEval, Board>();
+    voronoi->calculate(state);
+
+    // region sizes are in half cells
+    EXPECT_EQ((width * height / 2 - 1) * 2, voronoi->playerRegionSize(0)) << width << "x" << height;
+    EXPECT_EQ((width * height / 2 - 1) * 2, voronoi->playerRegionSize(1)) << width << "x" << height;
+    delete voronoi;
+}
+
+TEST(Voronoi, BigBoardsEqualRegions) {
+    expectEqualRegions<100, 100>();
+    // wide coordinates and room ids
+    expectEqualRegions<200, 200>();
+}
+
 TEST(Voronoi, ShouldFindTwoRegionsWhenDividedHorizontally) {
     State state;
     state.numPlayers = 2;
@@ -210,6 +199,24 @@ TEST(Scoring, ConnectedRegionsScoreOnVoronoi) {
     ASSERT_EQ(243, scores.scores[1]);
 }
 
+TEST(Scoring, RegionsTieTheScoresOfPlayersWhoMeet) {
+    State state;
+    state.numPlayers = 3;
+    state.thisPlayer = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        state.occupy(15, y, 2);
+    }
+    state.occupy(5, 5, 0);
+    state.occupy(5, 15, 1);
+    state.occupy(25, 10, 2);
+
+    Voronoi voronoi;
+    Scores scores = calculateScores(voronoi, state, 0);
+
+    ASSERT_EQ(scores.regions[0], scores.regions[1]) << "Expected players 0 and 1 to share a region";
+    ASSERT_NE(scores.regions[0], scores.regions[2]) << "Expected the wall to keep player 2 apart";
+}
+
 TEST(Scoring, CutOffOnAllSides) {
     State state;
     state.numPlayers = 2;
@@ -245,6 +252,92 @@ TEST(Scoring, Dead) {
     ASSERT_EQ(WIDTH * HEIGHT - 1 + 1000, scores.scores[1]);
 }
 
+TEST(Scoring, DeathPenaltyParam) {
+    State state;
+    state.numPlayers = 2;
+
+    state.occupy(0, 0, 0);
+    state.occupy(MAX_X, MAX_Y, 1);
+
+    state.kill(0);
+
+    Voronoi voronoi;
+    Scores defaults = calculateScores(voronoi, state);
+    voronoi.params[DEATH_PENALTY] = 500;
+    Scores scores = calculateScores(voronoi, state);
+
+    ASSERT_EQ(-500, scores.scores[0]);
+    ASSERT_EQ(defaults.scores[1] - 500, scores.scores[1]) << "Expected the survivor to gain the dead player's penalty";
+}
+
+TEST(Scoring, EvalVariants) {
+    State state;
+    state.numPlayers = 2;
+    state.occupy(5, 10, 0);
+    state.occupy(25, 10, 1);
+
+    Voronoi voronoi;
+    Scores expected = calculateScores(voronoi, state);
+
+    const EvalVariant* standard = findEvalVariant("standard");
+    ASSERT_TRUE(standard != 0);
+    void* evaluator = standard->create(EvalParams());
+    Scores scores;
+    standard->evaluate(scores, evaluator, state, 0);
+    standard->destroy(evaluator);
+    ASSERT_EQ(expected.scores[0], scores.scores[0]);
+    ASSERT_EQ(expected.scores[1], scores.scores[1]);
+
+    const EvalVariant* plain = findEvalVariant("plain");
+    ASSERT_TRUE(plain != 0);
+    evaluator = plain->create(EvalParams());
+    plain->evaluate(scores, evaluator, state, 0);
+    plain->destroy(evaluator);
+    ASSERT_EQ((WIDTH * HEIGHT - 2) * 2, scores.scores[0] + scores.scores[1])
+        << "Expected every free cell to be counted without no man's land";
+    ASSERT_GT(scores.scores[0] + scores.scores[1], expected.scores[0] + expected.scores[1]);
+
+    ASSERT_TRUE(findEvalVariant("none") == 0);
+}
+
+TEST(Scoring, ReadEvalParams) {
+    EvalParams params;
+    istringstream is("death_penalty 1500\nshared_room_penalty 80\n");
+    ASSERT_TRUE(params.read(is));
+    ASSERT_EQ(1500, params[DEATH_PENALTY]);
+    ASSERT_EQ(80, params[SHARED_ROOM_PENALTY]);
+    ASSERT_EQ(1, params[DOOR_PENALTY]) << "Expected unmentioned parameters to keep their defaults";
+
+    ostringstream os;
+    params.write(os);
+    EvalParams copy;
+    istringstream copied(os.str());
+    ASSERT_TRUE(copy.read(copied));
+    for (int i = 0; i < EVAL_PARAMS; i++) {
+        ASSERT_EQ(params[i], copy[i]);
+    }
+
+    istringstream bad("colour 3\n");
+    ASSERT_FALSE(params.read(bad));
+}
+
+TEST(Corpus, RejectPlayersOutsideTheGame) {
+    vector<Position> positions;
+    istringstream is("position ok\nplayers 2\nkill 1\nhead 0 3 4\n");
+    ASSERT_TRUE(loadCorpus(is, positions));
+
+    const char* bad[] = {
+        "position bad\nplayers 2\nkill 2\n",
+        "position bad\nplayers 2\nkill -1\n",
+        "position bad\nplayers 2\nhead 5 3 4\n",
+        "position bad\nplayers 9\n",
+    };
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        istringstream badIs(bad[i]);
+        ASSERT_FALSE(loadCorpus(badIs, positions)) << "Expected line to be rejected: " << bad[i];
+    }
+}
+
 class ScoreCalculatorMock {
 private:
     int expectedCalls;
@@ -425,6 +518,104 @@ TEST(State, RevivingDeadPlayersPreservesOtherPlayers) {
     ASSERT_TRUE(state.occupied(0, 0));
 }
 
+TEST(State, UnmakeMoveRestoresTheJournaledPosition) {
+    State state;
+    state.setHashing(true);
+    state.numPlayers = 3;
+    state.thisPlayer = 0;
+    state.occupy(4, 4, 0);
+    state.occupy(9, 4, 1);
+    state.occupy(4, 9, 2);
+    state.kill(2);
+    State before = state;
+    uint64_t key = state.key(0);
+
+    state.makeMove(0, 5, 4);
+    state.makeMove(1, 8, 4);
+    state.makeDeath(0);
+    state.makeMove(1, 8, 5);
+    ASSERT_EQ(4, state.journalSize);
+    ASSERT_EQ(0, state.journal[2].player);
+    ASSERT_TRUE(state.journal[2].died);
+    ASSERT_EQ(8, state.journal[3].fromX);
+    ASSERT_EQ(4, state.journal[3].fromY);
+    ASSERT_EQ(2, state.deathCount);
+    ASSERT_EQ(0, state.deadList[1]);
+    ASSERT_NE(key, state.key(0));
+
+    while (state.journalSize) {
+        state.unmakeMove();
+    }
+    ASSERT_TRUE(state.sameBoard(before)) << "Expected every move and death to be taken back";
+    ASSERT_EQ(key, state.key(0));
+    ASSERT_EQ(2, state.deadList[0]) << "Expected the earlier death to stand";
+    ASSERT_TRUE(state.occupied(9, 4));
+    ASSERT_FALSE(state.occupied(8, 4));
+}
+
+TEST(State, UnmakeMoveOverADeadTrailKeepsTheTrail) {
+    State state;
+    state.numPlayers = 3;
+    state.thisPlayer = 0;
+    state.occupy(4, 4, 0);
+    state.occupy(5, 5, 1);
+    state.occupy(5, 4, 2);
+    state.occupy(6, 4, 2);
+    State before = state;
+
+    state.makeMove(1, 5, 6);
+    state.makeDeath(2);
+    ASSERT_FALSE(state.occupied(5, 4));
+    state.makeMove(0, 5, 4);
+    ASSERT_TRUE(state.occupied(5, 4));
+    state.makeDeath(0);
+    ASSERT_FALSE(state.occupied(5, 4)) << "Expected no living trail at the cell";
+    ASSERT_FALSE(state.occupied(4, 4)) << "Expected the dead player's own trail to be free";
+    ASSERT_TRUE(state.occupied(5, 5)) << "Expected the living player's trail to stay";
+
+    while (state.journalSize) {
+        state.unmakeMove();
+    }
+    ASSERT_EQ(2, state.cell(5, 4)) << "Expected the dead player's trail back under the move";
+    ASSERT_TRUE(state.occupied(5, 4));
+    ASSERT_TRUE(state.occupied(6, 4));
+    ASSERT_TRUE(state.sameBoard(before)) << "Expected every move and death to be taken back";
+}
+
+TEST(State, DyingLeavesCellsAnotherLivingTrailCovers) {
+    State state;
+    state.numPlayers = 2;
+    state.occupy(3, 3, 0);
+    state.occupy(3, 3, 1);
+    state.occupy(4, 3, 1);
+    state.makeDeath(1);
+    ASSERT_TRUE(state.occupied(3, 3)) << "Expected the living player's cell to stay blocked";
+    ASSERT_FALSE(state.occupied(4, 3));
+    state.unmakeMove();
+    ASSERT_TRUE(state.occupied(4, 3));
+}
+
+TEST(State, SixteenPlayers) {
+    typedef BoardSize<WIDTH, HEIGHT, 16> Board;
+    BasicState<Board> state;
+    state.numPlayers = 16;
+    for (int i = 0; i < 16; i++) {
+        state.occupy(i, 0, i);
+    }
+    state.kill(15);
+    state.kill(7);
+
+    ASSERT_TRUE(state.occupied(14, 0));
+    ASSERT_FALSE(state.occupied(15, 0)) << "Expected the highest player's trail to go with them";
+    ASSERT_FALSE(state.occupied(7, 0));
+    ASSERT_TRUE(state.occupied(-1, 0)) << "Expected walls to stay whoever is dead";
+    ASSERT_TRUE(state.occupied(WIDTH, HEIGHT - 1));
+    ASSERT_EQ(14, state.livingCount());
+    ASSERT_EQ(14, state.cell(14, 0)) << "Expected each cell to hold its player's id";
+    ASSERT_EQ(int(BasicState<Board>::EMPTY), state.cell(15, 0));
+    ASSERT_EQ(int(BasicState<Board>::WALL), state.cell(-1, 0));
+}
+
 struct TestResults_PSDWNLM {
     int calls;
     int turn;
@@ -676,43 +867,20 @@ TEST(Minimax, ScoreFairlyWithOneDeathAndAClearWinner) {
 
 TEST(Minimax, BadDecision1) {
     State state;
-    state.numPlayers = 4;
-    state.thisPlayer = 0;
-    state.maxDepth = 8;
-    state.pruneMargin = 1;
-    state.timeLimitEnabled = false;
-
-    readBoard(state,
-        "....*....*....*....*....*....*\n"
-        "....*....*.11.*....*....*....*\n"
-        "..2222...*.1..*....*....*....*\n"
-        "....*2...*.1..*....*....*....*\n"
-        "....*22..*.1..*....*....*....*\n"
-        "....*.2..*.11.*....*....*....*\n"
-        "....*.2222..1.*....*....*..3D*\n"
-        "....*....2..11*....*....*..33*\n"
-        "....*....2...11.3333333333333*\n"
-        "....*....2....1133.*....*....*\n"
-        "....*....22..111.3.*....*0000A\n"
-        "....*....*2..1*..3.*....*0000*\n"
-        "....*....*2..1*..3.*...000000*\n"
-        "....*....*2..1*..333...00000.*\n"
-        "....*....*2..1*....33333*00000\n"
-        "....*....*2..1*....*....*00000\n"
-        "....*....*2..1*....*....*....*\n"
-        "....*....*2.11*....*....*....*\n"
-        "....*....C2211B....*....*....*\n"
-        "....*....22211*....*....*....*\n");
+    ASSERT_TRUE(loadPosition(state, "BadDecision1"));
 
     Voronoi voronoi;
     Bounds bounds;
 
     state.pruningEnabled = false;
+    state.nodesSearched = 0;
     Scores scores1 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
 
     state.pruningEnabled = true;
+    state.nodesSearched = 0;
     Scores scores2 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
 
+    ASSERT_EQ(scores1.move, scores2.move) << "Expected same move with and without pruning";
     ASSERT_EQ(scores1.scores[0], scores2.scores[0]) << "Expected same result for p0 with and without pruning";
     ASSERT_EQ(scores1.scores[1], scores2.scores[1]) << "Expected same result for p0 with and without pruning";
     ASSERT_EQ(scores1.scores[2], scores2.scores[2]) << "Expected same result for p0 with and without pruning";
@@ -770,48 +938,35 @@ TEST(State, Door) {
     ASSERT_FALSE(state.isDoor(25, 2, 0, -1)) << "Expected no door above p3";
 }
 
-TEST(Minimax, BadDecision2) {
+TEST(State, DoorsFollowTrails) {
     State state;
-    state.numPlayers = 4;
-    state.thisPlayer = 0;
-    state.maxDepth = 8;
-    state.timeLimitEnabled = false;
+    state.numPlayers = 2;
 
     readBoard(state,
-        "....*....*....*....*....*....*\n"
-        "....*....3333.*....*....*....*\n"
-        "..3333..33333.*....*....*...2*\n"
-        "..3333..333222*....*....*...2*\n"
-        "..3333.3333222*....*222.*...2*\n"
-        "..333..333322.*....*222.....2*\n"
-        "..333..333322.*....*.2222...2*\n"
-        "..33...3..322.*....*.2222...2*\n"
-        ".A333.33..32222........22...2*\n"
-        ".0333.3...322.2....*...22..22*\n"
-        ".0333D3...3.222....*...22.22..\n"
-        ".033333..*32222222222222222..*\n"
-        ".0.3333..*3C2222222222.......*\n"
-        ".003*.3..*332222222222......00\n"
-        ".003333..*..000000000000000000\n"
-        ".00330000000000000000000000000\n"
-        ".00330...*....*....*....*....*\n"
-        ".003300000000000...*....*....*\n"
-        ".003300000000000...*....*....*\n"
-        ".00000........*....*....*....*\n");
+        "..1..\n"
+        ".A...\n"
+        "..1..\n"
+        "....B\n");
 
-    Voronoi voronoi;
-    Bounds bounds;
+    ASSERT_TRUE(state.isDoor(1, 1, 1, 0)) << "Expected a door between p1's trail";
+    ASSERT_TRUE(state.isDoor(2, 1, -1, 0)) << "Expected the same door from the other side";
+    state.kill(1);
+    ASSERT_FALSE(state.isDoor(1, 1, 1, 0)) << "Expected a dead player's trail to make no door";
+    state.revive(1);
+    ASSERT_TRUE(state.isDoor(1, 1, 1, 0));
+    state.unoccupy(2, 0, 1);
+    ASSERT_FALSE(state.isDoor(1, 1, 1, 0)) << "Expected no door once the trail is freed";
+    state.occupy(1, 0, 0);
+    ASSERT_TRUE(state.isDoor(1, 1, 1, 0)) << "Expected a door when a cell above either side is occupied";
+    ASSERT_FALSE(state.isDoor(1, 0, 0, 1)) << "Expected no door along a column with open sides";
+}
 
-    // player 1 is dead already
-    state.players[1].x = 0;
-    state.players[1].y = 0;
+TEST(Minimax, BadDecision2) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision2"));
 
-    playTurn(state,
-        "4 0\n"
-        "12 14 1 7\n"
-        "0 0 0 0\n"
-        "28 2 11 12\n"
-        "11 13 5 9\n");
+    Voronoi voronoi;
+    Bounds bounds;
 
     state.pruningEnabled = false;
     Scores scores1 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
@@ -827,34 +982,7 @@ TEST(Minimax, BadDecision2) {
 
 TEST(Minimax, BadDecision4) {
     State state;
-    state.numPlayers = 4;
-    state.thisPlayer = 2;
-    state.maxDepth = 4;
-    state.timeLimitEnabled = false;
-    state.pruningEnabled = false;
-
-    // Game #983770: should have killed p3 (but that gives p0 enough territory to win)
-    readBoard(state,
-        "....1...0000000000000000000000\n"
-        "....11110000000000000000000000\n"
-        "....11.111111111111111..*...00\n"
-        "....11.11111B.*....*.1333...00\n"
-        "....111..11111111..*.130000.00\n"
-        "....1.11111111111..*.130*...00\n"
-        "....11111111111111.*.130000000\n"
-        "....2222222222222111113.*.0000\n"
-        "....*....*....*22333333.*.000*\n"
-        "....*....*....2233.*....*.000*\n"
-        "22222222222222233..*....*.0A.*\n"
-        "2.33333333333333...*....*....*\n"
-        "22333333333333333333333333...*\n"
-        ".22222222222222222222222*3...*\n"
-        "....*....*....*....*...233...*\n"
-        "....*....*....*....*...233...*\n"
-        "....*....*....*....*...223...*\n"
-        "....*....*....*....*.22223...*\n"
-        "....*....*..C2222222223333...*\n"
-        "....*....*...D333333333.*....*\n");
+    ASSERT_TRUE(loadPosition(state, "BadDecision4"));
 
     Voronoi voronoi;
     Bounds bounds;
@@ -865,36 +993,7 @@ TEST(Minimax, BadDecision4) {
 
 TEST(Minimax, BadDecision5) {
     State state;
-    state.numPlayers = 4;
-    state.thisPlayer = 2;
-    state.maxDepth = 5;
-    state.timeLimitEnabled = false;
-    state.pruningEnabled = false;
-
-    // Game #2305658: should have chosen larger room
-    readBoard(state,
-        "....*222222222222222222222222*\n"
-        "....*2...*....*....*....*.222*\n"
-        "222.*2...*....*....*....*22.22\n"
-        "222.*2..000000000000000002...2\n"
-        "222.*2..0*....*....*....22...2\n"
-        "222222..0*....*....*....2...22\n"
-        "2222*...0*....*....*....2...2*\n"
-        "2222*...0*....*....*....2...2*\n"
-        "2222*...0*...333333333332...2*\n"
-        "222.*.00000...*....*...32...2*\n"
-        "222.0000.*00000..00000A32...2*\n"
-        "222.00000000000..00000.32...2*\n"
-        "22..00000000000000.000.32...2*\n"
-        ".2.0000000000000000000.32...2*\n"
-        ".2.0000000000000000*00.322222*\n"
-        ".C..*....*....*....*...333322*\n"
-        "3D..*....*....*....*....*.322*\n"
-        "33333333333333333333333333322*\n"
-        "333333333333333333333333333333\n"
-        "333333333333333333333333333333\n");
-
-    state.kill(1);
+    ASSERT_TRUE(loadPosition(state, "BadDecision5"));
 
     Voronoi voronoi;
     Bounds bounds;
@@ -903,36 +1002,121 @@ TEST(Minimax, BadDecision5) {
     ASSERT_EQ(scores.move, RIGHT) << "Expected p2 to choose the larger room";
 }
 
-TEST(Minimax, BadDecision6) {
+TEST(Minimax, ParanoidChoosesTheLargerRoom) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision5"));
+
+    Voronoi voronoi;
+    Scores scores;
+    paranoid(scores, INT_MIN, INT_MAX, state, 0, voronoi);
+    ASSERT_EQ(scores.move, RIGHT) << "Expected p2 to choose the larger room";
+}
+
+TEST(Minimax, ParanoidSearchesBoardsWithMorePlayers) {
+    typedef BoardSize<WIDTH, HEIGHT, 8> Board;
+    BasicState<Board> state;
+    state.numPlayers = 6;
+    state.thisPlayer = 5;
+    state.maxDepth = 7;
+    state.timeLimitEnabled = false;
+    for (int i = 0; i < 6; i++) {
+        state.occupy(4 + 4 * i, 10, i);
+    }
+    // the last player is walled in on their right and below
+    state.occupy(25, 10, 0);
+    state.occupy(24, 11, 0);
+
+    BasicVoronoi<StandardEval, Board> voronoi;
+    BasicScores<Board::players> scores;
+    BasicBounds<Board::players> bounds;
+    paranoidRecursive<StandardEval, Board>(scores, bounds, state, 0, 0, &voronoi);
+    ASSERT_TRUE(scores.move == UP || scores.move == LEFT) << "Expected p5 to move into free space";
+    ASSERT_GT(state.nodesSearched, 0);
+}
+
+// Search a copy of a position to a depth, with selective search within a range, for the nodes
+long selectiveNodes(const State& position, int depth, int selectiveRange) {
+    State state = position;
+    state.maxDepth = depth;
+    state.selectiveRange = selectiveRange;
+    state.timeLimitEnabled = false;
+    Voronoi voronoi;
+    Bounds bounds;
+    minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+    EXPECT_EQ(0, state.depthAdjustment) << "Expected every extension and reduction to be undone";
+    return state.nodesSearched;
+}
+
+TEST(Minimax, SelectiveSearchExtendsContact) {
     State state;
+    state.numPlayers = 2;
     state.thisPlayer = 0;
+    state.occupy(14, 10, 0);
+    state.occupy(15, 10, 1);
+
+    ASSERT_GT(selectiveNodes(state, 3, 2), selectiveNodes(state, 3, 0)) << "Expected heads in contact to search deeper";
+}
+
+TEST(Minimax, SelectiveSearchReducesSeparatedPlayers) {
+    State state;
     state.numPlayers = 2;
+    state.thisPlayer = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        state.occupy(15, y, 1);
+    }
+    state.occupy(5, 10, 0);
+    state.occupy(20, 10, 1);
+
+    ASSERT_LT(selectiveNodes(state, 6, 3), selectiveNodes(state, 6, 0))
+        << "Expected players out of reach to search shallower";
+}
+
+TEST(Minimax, SeparatedGroupsAreSearchedApart) {
+    State state;
+    state.numPlayers = 4;
+    state.thisPlayer = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        state.occupy(15, y, 3);
+    }
+    state.occupy(5, 5, 0);
+    state.occupy(5, 15, 1);
+    state.occupy(25, 5, 2);
+    state.occupy(25, 15, 3);
     state.maxDepth = 8;
-    state.pruningEnabled = false;
     state.timeLimitEnabled = false;
+    state.decompositionEnabled = true;
+    // our group with the other side of the wall empty
+    State alone;
+    alone.numPlayers = 2;
+    alone.thisPlayer = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        alone.occupy(15, y, 1);
+    }
+    alone.occupy(5, 5, 0);
+    alone.occupy(5, 15, 1);
+    alone.maxDepth = 8;
+    alone.timeLimitEnabled = false;
 
-    // Game 2347452: should choose larger region
-    readBoard(state,
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*....*....*....*\n"
-        "....*....*....*.1..*....*....*\n"
-        "....*....*....*.1..*....*....*\n"
-        "....*....*....*.B..*....*....*\n"
-        "....*....*....*.A..*....*....*\n"
-        "....*....*....*.0..*....*....*\n"
-        "....*....*....*.0..*....*....*\n");
+    Voronoi voronoi;
+    Bounds bounds;
+    Scores scores, aloneScores;
+    Scores root = calculateScores(voronoi, state);
+    voronoiRecursive(scores, bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+    voronoiRecursive(aloneScores, bounds, alone, 0, (void*) voronoiRecursive, &voronoi);
+
+    ASSERT_EQ(alone.nodesSearched, state.nodesSearched)
+        << "Expected our group to search as deep as if it were alone, the others' turns costing nothing";
+    ASSERT_EQ(aloneScores.move, scores.move);
+    ASSERT_EQ(State::PlayerSet(~0), state.moving) << "Expected every player to move again after the search";
+    ASSERT_EQ(0, state.passes);
+    for (int i = 2; i < 4; i++) {
+        ASSERT_EQ(root.scores[i], scores.scores[i]) << "Expected player " << i << " to keep their static score";
+    }
+}
+
+TEST(Minimax, BadDecision6) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision6"));
 
     Voronoi voronoi;
     Bounds bounds;
@@ -941,36 +1125,33 @@ TEST(Minimax, BadDecision6) {
     ASSERT_EQ(LEFT, scores.move) << "Expected p0 to choose the larger region";
 }
 
-TEST(Minimax, DISABLED_BadDecision7) {
+TEST(Minimax, PruningCutsOffLinesWithoutChangingTheResult) {
     State state;
-    state.thisPlayer = 3;
-    state.numPlayers = 4;
-    state.maxDepth = 5;
+    ASSERT_TRUE(loadPosition(state, "BadDecision6"));
+    state.maxDepth = 8;
+
+    Voronoi voronoi;
+    Bounds bounds;
+
     state.pruningEnabled = false;
-    state.timeLimitEnabled = false;
+    state.nodesSearched = 0;
+    Scores scores1 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+    int nodes1 = state.nodesSearched;
 
-    // Game 2347452: should choose larger region (we come last anyway, so not important)
-    readBoard(state,
-        "22222222.*....*....*....*...11\n"
-        "2222*..2.*....*....*....*...11\n"
-        "3332*..2.*....*....*....*...11\n"
-        "3.32*..2.*....*....*....*...11\n"
-        "3.32*..2.*....*....*....*...11\n"
-        "3.32*..2.000..*....*....111111\n"
-        "3.32*..2.0.0..*....*....1...11\n"
-        "3.32*..2.0.00.*....*.1111...1B\n"
-        "3.32*..2.0..0000000011..*...1*\n"
-        "333222.2.0....*...00111111111*\n"
-        "333333.2.0....*...0*....*....*\n"
-        ".33.*322.0....*...0*....*....*\n"
-        "....*322.0....*...0*....*....*\n"
-        "....*33C.0....*...0*....*....*\n"
-        "....*.3..0....*...0*....*....*\n"
-        "....*.3..0....*...0*....*....*\n"
-        "....*.3..0....*...0*....*....*\n"
-        "....*.3..0....*...0*....*....*\n"
-        "....*.3D.A....*....*....*....*\n"
-        "....*....*....*....*....*....*\n");
+    state.pruningEnabled = true;
+    state.nodesSearched = 0;
+    Scores scores2 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+
+    ASSERT_LT(state.nodesSearched, nodes1) << "Expected pruning to cut off some lines";
+    ASSERT_EQ(scores1.move, scores2.move) << "Expected same move with and without pruning";
+    for (int i = 0; i < state.numPlayers; i++) {
+        ASSERT_EQ(scores1.scores[i], scores2.scores[i]) << "Expected same result for p" << i << " with and without pruning";
+    }
+}
+
+TEST(Minimax, DISABLED_BadDecision7) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision7"));
 
     Voronoi voronoi;
     Bounds bounds;
@@ -1133,6 +1314,12 @@ public:
         }
     }
 
+    void setNodeBudget(int nodes) {
+        for (int i = 0; i < numPlayers; i++) {
+            states[i].setNodeBudget(nodes);
+        }
+    }
+
     void playTurn() {
         int i = turn % numPlayers;
         cerr << "Turn " << i << endl;
@@ -1199,6 +1386,34 @@ TEST(Pruning, DISABLED_PlaySelf) {
     // pruningOn.states[0].print();
 }
 
+// A clock which runs out any time limit at once
+long racingClock() {
+    static long now = 0;
+    return now += 1000;
+}
+
+TEST(Minimax, NodeBudgetPlaysTheSameGame) {
+    int sx[] = {3, 26, 15};
+    int sy[] = {4, 16, 10};
+    GameSim first(sx, sy, 3, true);
+    GameSim second(sx, sy, 3, true);
+    for (int i = 0; i < 3; i++) {
+        second.states[i].timeLimit = 1;
+        second.states[i].clock = racingClock;
+    }
+    first.setNodeBudget(3000);
+    second.setNodeBudget(3000);
+
+    for (int j = 0; j < 30; j++) {
+        first.playTurn();
+        second.playTurn();
+        const State& state = first.states[j % 3];
+        ASSERT_STREQ(first.scores.move, second.scores.move) << "Expected the same move at turn " << j;
+        ASSERT_EQ(state.nodesSearched, second.states[j % 3].nodesSearched);
+        ASSERT_LE(state.nodesSearched, 3000 + 100) << "Expected the search to stop near its budget";
+    }
+}
+
 TEST(Scoring, DISABLED_ShouldSetLosersWhenSingleOccupantOfLargestRegion) {
     State state;
     readBoard(state,
@@ -1456,16 +1671,7 @@ TEST(Voronoi, RoomLoop) {
 
 TEST(Voronoi, PlayerOnBoundary) {
     State state;
-    state.numPlayers = 2;
-
-    readBoard(state,
-        ".0..0....*....11111111..*....*\n"
-        ".0..0....*....1..1.*.1..*....*\n"
-        ".0A00....*....1..B.*.1..*....*\n"
-        ".0..0....*....111.1111..*....*\n"
-        ".0..0....*....*.1....1..*....*\n"
-        ".0..0....*....*.1....1..*....*\n"
-        ".0000....*....*.111111..*....*\n");
+    ASSERT_TRUE(loadPosition(state, "PlayerOnBoundary"));
 
     Voronoi voronoi;
     voronoi.calculate(state);
@@ -1695,17 +1901,7 @@ TEST(Voronoi, SharedRoomWithAdjacentRooms) {
 
 TEST(Voronoi, PlayerOnBoundary2) {
     State state;
-    state.numPlayers = 2;
-
-    readBoard(state,
-        "000000......0..\n"
-        "0....0......0..\n"
-        "00...0000...0..\n"
-        "0A.00.*..0.B0..\n"
-        "0.....*.....0..\n"
-        "0.....*.....0..\n"
-        "0000000000..0..\n"
-        ".........0000..\n");
+    ASSERT_TRUE(loadPosition(state, "PlayerOnBoundary2"));
 
     Voronoi voronoi;
     voronoi.calculate(state, 0);
@@ -1813,3 +2009,423 @@ TEST(Scoring, DoorPenalty) {
     ASSERT_EQ(2 * 8 - 1, scores.scores[2]) << "Expected p2 to incur a single door penalty";
     ASSERT_EQ(2 * 26 - 2, scores.scores[3]) << "Expected p3 to incur a double door penalty";
 }
+
+TEST(Perft, OpenBoard) {
+    State state;
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+    state.occupy(5, 10, 0);
+    state.occupy(24, 10, 1);
+
+    ASSERT_EQ(4, perft(state, 0, 1));
+    ASSERT_EQ(16, perft(state, 0, 2));
+    ASSERT_EQ(48, perft(state, 0, 3)) << "Expected players not to move back onto their own trail";
+}
+
+TEST(Perft, DeadPlayersPass) {
+    State state;
+    state.numPlayers = 3;
+    state.thisPlayer = 0;
+    state.occupy(5, 10, 0);
+    state.occupy(15, 10, 1);
+    state.occupy(24, 10, 2);
+    state.kill(1);
+
+    ASSERT_EQ(16, perft(state, 0, 3)) << "Expected player 1 to take no moves";
+    state.decompositionEnabled = true;
+    ASSERT_EQ(48, perft(state, 0, 3)) << "Expected player 1's pass to take no ply with groups searched apart";
+}
+
+TEST(Perft, MovesAndDeathsAreUnmade) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "Pocket", "perft.txt"));
+    State before = state;
+
+    ASSERT_EQ(822, perft(state, 0, 10, true));
+    ASSERT_TRUE(state.sameBoard(before)) << "Expected the board to be restored";
+}
+
+TEST(Perft, SearchScoresEveryLeafWithoutPruning) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "Pocket", "perft.txt"));
+    state.maxDepth = 6;
+    state.pruningEnabled = false;
+    state.timeLimitEnabled = false;
+
+    ASSERT_EQ(perft(state, 0, 6), countLeaves(state));
+}
+
+TEST(Perft, CountersReadOrFallBack) {
+    State state;
+    state.numPlayers = 2;
+    state.occupy(5, 10, 0);
+    state.occupy(24, 10, 1);
+    PerfCounters perf;
+    perf.start();
+    perft(state, 0, 4);
+    perf.stop();
+    if (perf.available()) {
+        ASSERT_NE(0, perf.values[PERF_INSTRUCTIONS]) << "Expected the work to be counted";
+    } else {
+        ASSERT_FALSE(perf.error.empty()) << "Expected a reason when no counter could be opened";
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            ASSERT_EQ(-1, perf.values[i]);
+        }
+    }
+}
+
+TEST(Arena, GameIsPlayedToTheEnd) {
+    vector<Engine> engines(2);
+    engines[0].name = "a";
+    engines[0].maxDepth = 2;
+    engines[0].timeLimit = 0;
+    engines[1] = engines[0];
+    engines[1].name = "b";
+    int seats[PLAYERS] = {0, 1, 0, 1};
+    int starts[PLAYERS][2];
+    randomStarts(4, 7, starts);
+    GameResult result;
+
+    playGame(engines, 4, seats, starts, 0, result);
+
+    int ranks = 0;
+    for (int i = 0; i < 4; i++) {
+        ranks |= 1 << result.ranks[i];
+        ASSERT_EQ(seats[i], result.seats[i]);
+        ASSERT_GT(result.moves[i], 0);
+    }
+    ASSERT_EQ(15, ranks) << "Expected each player to finish in a different place";
+    ASSERT_GT(result.turns, 1);
+}
+
+TEST(Arena, EngineSpec) {
+    Engine engine;
+    ASSERT_TRUE(engine.parse("fast:depth=10,pruning=on,time=50"));
+    ASSERT_EQ("fast", engine.name);
+    ASSERT_EQ(10, engine.maxDepth);
+    ASSERT_TRUE(engine.pruningEnabled);
+    ASSERT_EQ(50, engine.timeLimit);
+    ASSERT_FALSE(engine.parse("bad:colour=red"));
+    ASSERT_TRUE(engine.parse("doors:eval=doors"));
+    ASSERT_EQ(findEvalVariant("doors"), engine.variant);
+    ASSERT_FALSE(engine.parse("bad:eval=none"));
+}
+
+TEST(Arena, EloFromScore) {
+    Tally tally;
+    tally.wins = 60;
+    tally.losses = 40;
+    double error;
+    ASSERT_NEAR(70.4, elo(tally, error), 0.1);
+    ASSERT_GT(error, 0);
+    ASSERT_GT(sprtLLR(tally, 0, 10), 0) << "Expected a winning record to favour the stronger hypothesis";
+
+    tally.wins = 40;
+    tally.losses = 60;
+    ASSERT_NEAR(-70.4, elo(tally, error), 0.1);
+    ASSERT_LT(sprtLLR(tally, 0, 10), 0);
+}
+
+TEST(Trace, RingKeepsLatestEvents) {
+    State state;
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+    state.maxDepth = 4;
+    state.timeLimitEnabled = false;
+    state.occupy(5, 10, 0);
+    state.occupy(24, 10, 1);
+
+    Voronoi voronoi;
+    Bounds bounds;
+    tracer = new Tracer(8);
+    Scores scores = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+
+    FILE* file = tmpfile();
+    tracer->write(file, 3, state.numPlayers, state.thisPlayer, state.maxDepth);
+    delete tracer;
+    tracer = 0;
+    rewind(file);
+
+    TraceHeader header;
+    ASSERT_EQ(1u, fread(&header, sizeof(header), 1, file));
+    ASSERT_EQ(3, header.turn);
+    ASSERT_EQ(256u, header.events) << "Expected the ring to keep only the latest events";
+    ASSERT_GT(header.dropped, 0u);
+
+    vector<TraceEvent> events(header.events);
+    ASSERT_EQ(header.events, fread(&events[0], sizeof(TraceEvent), header.events, file));
+    fclose(file);
+    for (unsigned i = 1; i < events.size(); i++) {
+        ASSERT_EQ(events[i - 1].sequence + 1, events[i].sequence);
+    }
+    const TraceEvent& last = events.back();
+    ASSERT_EQ(TRACE_CHOOSE, last.type);
+    ASSERT_EQ(0, last.turn);
+    ASSERT_EQ(scores.move, moveName(last.move));
+    ASSERT_EQ(scores.scores[0], last.scores[0]);
+}
+
+TEST(Book, MirrorImagesShareAnEntry) {
+    State state;
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+    state.occupy(4, 3, 0);
+    state.occupy(5, 3, 0);
+    state.occupy(20, 15, 1);
+    State mirrored;
+    mirrored.numPlayers = 2;
+    mirrored.thisPlayer = 0;
+    mirrored.occupy(MAX_X - 4, 3, 0);
+    mirrored.occupy(MAX_X - 5, 3, 0);
+    mirrored.occupy(MAX_X - 20, 15, 1);
+
+    State empty;
+    empty.numPlayers = 2;
+    empty.thisPlayer = 0;
+
+    int symmetry;
+    int otherSymmetry;
+    uint64_t key = state.canonicalKey(symmetry);
+    ASSERT_EQ(key, mirrored.canonicalKey(otherSymmetry));
+    ASSERT_NE(key, empty.canonicalKey(otherSymmetry));
+
+    // Carrying on to the right in one is carrying on to the left in the other
+    BookEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.key = key;
+    entry.move = symmetricMove(moveIndex(RIGHT), symmetry);
+    entry.depth = 12;
+    vector<BookEntry> entries(1, entry);
+    for (int i = 0; i < 100; i++) {
+        entry.key = mixBits(i);
+        entries.push_back(entry);
+    }
+    char path[] = "/tmp/tron_bookXXXXXX";
+    close(mkstemp(path));
+    ASSERT_TRUE(writeBook(path, entries));
+    Book book;
+    ASSERT_TRUE(book.open(path));
+    unlink(path);
+    ASSERT_EQ(RIGHT, book.lookup(state));
+    ASSERT_EQ(LEFT, book.lookup(mirrored));
+    ASSERT_EQ((const char*) 0, book.lookup(empty));
+}
+
+TEST(Book, BucketsBeyondTheEntriesAreRejected) {
+    vector<BookEntry> entries(10);
+    for (int i = 0; i < 10; i++) {
+        memset(&entries[i], 0, sizeof(BookEntry));
+        entries[i].key = mixBits(i);
+    }
+    char path[] = "/tmp/tron_bookXXXXXX";
+    close(mkstemp(path));
+    ASSERT_TRUE(writeBook(path, entries));
+    Book book;
+    ASSERT_TRUE(book.open(path));
+    book.close();
+
+    // the last bucket's end is the final word of the file
+    FILE* file = fopen(path, "r+b");
+    ASSERT_TRUE(file != 0);
+    uint32_t end = 11;
+    fseek(file, -(long) sizeof(end), SEEK_END);
+    fwrite(&end, sizeof(end), 1, file);
+    fclose(file);
+    ASSERT_FALSE(book.open(path)) << "Expected a bucket which ends past the entries to be rejected";
+    unlink(path);
+    ASSERT_FALSE(book.isOpen());
+}
+
+TEST(Scoring, PocketTableGivesExactFill) {
+    State state;
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+
+    // p0 enters the square by the middle of a side, so it can fill all but one of its cells
+    readBoard(state,
+        "11111.....\n"
+        "1...1.....\n"
+        "A...1.....\n"
+        "1...1.....\n"
+        "11111.....\n"
+        "..........\n"
+        ".........B\n");
+
+    Voronoi voronoi;
+    voronoi.flood(state, 0);
+    Pocket pocket;
+    ASSERT_TRUE(voronoi.findPocket(state, 0, pocket));
+    ASSERT_EQ(9, pocket.size);
+    ASSERT_EQ(8, longestFill(pocket));
+    Pocket other;
+    ASSERT_FALSE(voronoi.findPocket(state, 1, other)) << "Expected p1's region to be too big";
+
+    Pocket turned;
+    for (int i = 0; i < pocket.size; i++) {
+        turned.add(-pocket.dy[i], pocket.dx[i]);
+    }
+    ASSERT_EQ(pocket.key(), turned.key()) << "Expected the same key in every orientation";
+
+    Scores estimated = calculateScores(voronoi, state);
+    vector<PocketEntry> entries(1);
+    memset(&entries[0], 0, sizeof(PocketEntry));
+    entries[0].key = pocket.key();
+    entries[0].fill = 8;
+    char path[] = "/tmp/tron_pocketsXXXXXX";
+    close(mkstemp(path));
+    ASSERT_TRUE(writeTable(path, entries));
+    ASSERT_TRUE(pocketTable.open(path));
+    unlink(path);
+    Scores exact = calculateScores(voronoi, state);
+    pocketTable.close();
+
+    ASSERT_EQ(2 * 9, estimated.scores[0]);
+    ASSERT_EQ(2 * 8, exact.scores[0]);
+    ASSERT_EQ(estimated.scores[1], exact.scores[1]);
+}
+
+TEST(Scoring, EvalCacheKeepsMirrorImagesApart) {
+    // one key kept up to date move by move, and the other worked out afresh
+    State state;
+    state.setHashing(true);
+    state.numPlayers = 2;
+    state.thisPlayer = 0;
+    state.occupy(4, 3, 0);
+    state.occupy(5, 3, 0);
+    state.occupy(20, 15, 1);
+    State mirrored;
+    mirrored.numPlayers = 2;
+    mirrored.thisPlayer = 0;
+    mirrored.occupy(4, MAX_Y - 3, 0);
+    mirrored.occupy(5, MAX_Y - 3, 0);
+    mirrored.occupy(20, MAX_Y - 15, 1);
+
+    // revisiting a cell, and undoing a move, leave the key as it was
+    uint64_t key = state.key(0);
+    state.occupy(5, 3, 0);
+    ASSERT_EQ(key, state.key(0));
+    state.occupy(6, 3, 0);
+    ASSERT_NE(key, state.key(0));
+    state.unoccupy(6, 3, 0);
+    state.occupy(5, 3, 0);
+    ASSERT_EQ(key, state.key(0));
+
+    Voronoi voronoi;
+    Scores fresh = calculateScores(voronoi, state);
+    Scores freshMirrored = calculateScores(voronoi, mirrored);
+
+    voronoi.cache.resize(10);
+    ASSERT_NE(evaluationKey(state, 0), evaluationKey(mirrored, 0));
+    calculateScores(voronoi, mirrored);
+    Scores cached = calculateScores(voronoi, state);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(fresh.scores[i], cached.scores[i]) << "Expected the position's own scores, not its mirror image's";
+    }
+    ASSERT_EQ(freshMirrored.scores[0], calculateScores(voronoi, mirrored).scores[0]);
+
+    Scores scores;
+    scores.scores[0] = 123;
+    scores.scores[1] = 456;
+    voronoi.cache.store(evaluationKey(state, 0), scores.scores, scores.regions, 2);
+    Scores hit = calculateScores(voronoi, state);
+    ASSERT_EQ(123, hit.scores[0]) << "Expected the cached scores";
+    ASSERT_EQ(456, hit.scores[1]);
+    ASSERT_EQ(1, hit.ranks[1]);
+    Scores other = calculateScores(voronoi, state, 1);
+    ASSERT_NE(123, other.scores[0]) << "Expected another player flooding first to miss";
+}
+
+TEST(Doors, PatchedDoorsMatchRefreshedDoors) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision1"));
+    state.refreshDoorsNow();
+
+    for (int player = 0; player < state.numPlayers; player++) {
+        for (int move = 0; move < 4; move++) {
+            int x = state.players[player].x + xOffsets[move];
+            int y = state.players[player].y + yOffsets[move];
+            if (state.occupied(x, y)) {
+                continue;
+            }
+            State refreshed = state;
+            refreshed.makeMove(player, x, y);
+            state.makeMovePatchingDoors(player, x, y);
+            for (int i = StandardBoard::index(0, 0); i < StandardBoard::index(WIDTH - 1, HEIGHT - 1); i++) {
+                ASSERT_EQ(refreshed.isDoor(i, 1), state.isDoor(i, 1)) << "Expected the same door across from " << i;
+                ASSERT_EQ(refreshed.isDoor(i, StandardBoard::stride), state.isDoor(i, StandardBoard::stride))
+                    << "Expected the same door down from " << i;
+            }
+            refreshed.unmakeMove();
+            state.unmakeMovePatchingDoors();
+            for (int i = StandardBoard::index(0, 0); i < StandardBoard::index(WIDTH - 1, HEIGHT - 1); i++) {
+                ASSERT_EQ(refreshed.isDoor(i, 1), state.isDoor(i, 1)) << "Expected the doors back across from " << i;
+                ASSERT_EQ(refreshed.isDoor(i, StandardBoard::stride), state.isDoor(i, StandardBoard::stride))
+                    << "Expected the doors back down from " << i;
+            }
+        }
+    }
+}
+
+TEST(Scoring, LeafScoresMatchScoringEachMoveAlone) {
+    State state;
+    ASSERT_TRUE(loadPosition(state, "BadDecision1"));
+    int player = state.thisPlayer;
+    int moves[4];
+    int count = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!state.occupied(state.players[player].x + xOffsets[i], state.players[player].y + yOffsets[i])) {
+            moves[count++] = i;
+        }
+    }
+    ASSERT_GT(count, 1);
+
+    Voronoi voronoi;
+    for (int pass = 0; pass < 3; pass++) {
+        // without the cache, then filling it, then from it
+        if (pass == 1) {
+            voronoi.cache.resize(10);
+        }
+        Scores leafScores[4];
+        calculateSiblingScores(leafScores, moves, count, voronoi, state, player, 1);
+        for (int k = 0; k < count; k++) {
+            state.makeMove(player, state.players[player].x + xOffsets[moves[k]],
+                state.players[player].y + yOffsets[moves[k]]);
+            Voronoi alone;
+            Scores expected = calculateScores(alone, state, 1);
+            state.unmakeMove();
+            for (int i = 0; i < state.numPlayers; i++) {
+                ASSERT_EQ(expected.scores[i], leafScores[k].scores[i]) << "Expected the same score for p" << i;
+                ASSERT_EQ(expected.ranks[i], leafScores[k].ranks[i]) << "Expected the same rank for p" << i;
+                ASSERT_EQ(expected.regions[i], leafScores[k].regions[i]) << "Expected the same region for p" << i;
+            }
+        }
+    }
+}
+
+void leafByLeafRecursive(Scores& scores, Bounds& bounds, State& state, int turn, void* sc, void* data) {
+    policyRecursive<StandardEval>(scores, bounds, state, turn, sc, data);
+}
+
+TEST(Minimax, SiblingLeavesScoredFromTheParentGiveTheSameSearch) {
+    const char* positions[] = {"BadDecision1", "BadDecision2", "BadDecision6"};
+    for (int p = 0; p < 3; p++) {
+        State state;
+        ASSERT_TRUE(loadPosition(state, positions[p]));
+        state.timeLimitEnabled = false;
+        state.maxDepth = 6;
+
+        Voronoi voronoi;
+        Bounds bounds;
+        state.nodesSearched = 0;
+        Scores scores1 = minimax(bounds, state, 0, (void*) leafByLeafRecursive, &voronoi);
+        int nodes1 = state.nodesSearched;
+        state.nodesSearched = 0;
+        Scores scores2 = minimax(bounds, state, 0, (void*) voronoiRecursive, &voronoi);
+
+        ASSERT_EQ(nodes1, state.nodesSearched) << "Expected the same tree in " << positions[p];
+        ASSERT_EQ(scores1.move, scores2.move) << "Expected the same move in " << positions[p];
+        for (int i = 0; i < state.numPlayers; i++) {
+            ASSERT_EQ(scores1.scores[i], scores2.scores[i]) << "Expected the same score for p" << i << " in " << positions[p];
+        }
+    }
+}
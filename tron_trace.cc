@@ -0,0 +1,173 @@
+#include <string>
+#include <vector>
+#include "tron.cc"
+
+// Decodes search traces written by the bot (-t) or tron_replay (-x) back into the search tree:
+// each move tried with the scores it led to, each choice, and each cutoff, indented by ply.
+// Moves along a line are written as their initials, with X for a player who passes and G for a
+// player with no move.
+
+class TraceDecoder {
+private:
+    int numPlayers;
+    // the line being searched, and the line which led to the most recent scores
+    string line;
+    string value;
+    // the line behind each move's scores at each ply, so a choice can be traced to its leaf
+    vector<string> values[5];
+
+    void setLine(int turn, char move) {
+        if ((int) line.size() < turn) {
+            line.resize(turn, '?');
+        }
+        line.resize(turn);
+        line += move;
+    }
+
+    void indent(int turn) const {
+        for (int i = 0; i < turn; i++) {
+            cout << "  ";
+        }
+    }
+
+    void printScores(const TraceEvent& event, const string& leaf) const {
+        // events only keep the scores of the first PLAYERS players
+        for (int i = 0; i < min(numPlayers, PLAYERS); i++) {
+            cout << event.scores[i] << " / ";
+        }
+        cout << moveName(event.move) << " / " << leaf << endl;
+    }
+
+    string& valueAt(int turn, int move) {
+        if ((int) values[move].size() <= turn) {
+            values[move].resize(turn + 1, "?");
+        }
+        return values[move][turn];
+    }
+
+public:
+    // counts of each event type
+    long counts[TRACE_DIE + 1];
+
+    TraceDecoder(int p_numPlayers) : numPlayers(p_numPlayers) {
+        memset(counts, 0, sizeof(counts));
+        value = "?";
+    }
+
+    void decode(const TraceEvent& event, bool print) {
+        counts[event.type]++;
+        switch (event.type) {
+        case TRACE_ENTER:
+            break;
+        case TRACE_SKIP:
+            setLine(event.turn, 'X');
+            break;
+        case TRACE_DIE:
+            setLine(event.turn, 'G');
+            break;
+        case TRACE_MOVE:
+            setLine(event.turn, moveName(event.move)[0]);
+            break;
+        case TRACE_LEAF:
+            value = line.substr(0, event.turn);
+            break;
+        case TRACE_SCORE:
+            valueAt(event.turn, event.move) = value;
+            if (print) {
+                indent(event.turn);
+                cout << "player " << int(event.player) << ": ";
+                printScores(event, value);
+            }
+            break;
+        case TRACE_PRUNE:
+            if (print) {
+                indent(event.turn);
+                cout << "Pruned at " << value << endl;
+                indent(event.turn);
+                cout << "          " << string(event.turn, ' ') << "^" << endl;
+            }
+            break;
+        case TRACE_CHOOSE:
+            value = valueAt(event.turn, event.move);
+            if (print) {
+                indent(event.turn);
+                cout << "player " << int(event.player) << " chose ";
+                printScores(event, value);
+            }
+            break;
+        }
+    }
+};
+
+const char* const traceEventNames[TRACE_DIE + 1] = {"enter", "skip", "move", "leaf", "score", "prune", "choose", "die"};
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-t turn] [-s] tracefile" << endl;
+    cerr << "  -t  decode only this turn" << endl;
+    cerr << "  -s  summarise each turn's events instead of printing the tree" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    int onlyTurn = -1;
+    bool summary = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s")) != -1) {
+        switch (opt) {
+        case 't':
+            onlyTurn = atoi(optarg);
+            break;
+        case 's':
+            summary = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    FILE* file = fopen(argv[optind], "rb");
+    if (!file) {
+        cerr << "Cannot open " << argv[optind] << endl;
+        return 1;
+    }
+
+    TraceHeader header;
+    vector<TraceEvent> events;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (memcmp(header.magic, TRACE_MAGIC, 4) != 0) {
+            cerr << "Bad trace block" << endl;
+            return 1;
+        }
+        events.resize(header.events);
+        if (header.events && fread(&events[0], sizeof(TraceEvent), header.events, file) != header.events) {
+            cerr << "Truncated trace for turn " << header.turn << endl;
+            return 1;
+        }
+        if (onlyTurn >= 0 && header.turn != onlyTurn) {
+            continue;
+        }
+
+        cout << "Turn " << header.turn << ": player " << int(header.thisPlayer) << " of " << int(header.numPlayers)
+            << ", depth " << int(header.maxDepth) << ", " << header.events << " events";
+        if (header.dropped) {
+            cout << " (" << header.dropped << " earlier events lost)";
+        }
+        cout << endl;
+
+        TraceDecoder decoder(header.numPlayers);
+        for (unsigned i = 0; i < events.size(); i++) {
+            decoder.decode(events[i], !summary);
+        }
+        if (summary) {
+            for (int i = 0; i <= TRACE_DIE; i++) {
+                cout << "  " << traceEventNames[i] << " " << decoder.counts[i];
+            }
+            cout << endl;
+        }
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "tron.cc"
+#include "tron_game.cc"
+
+// SPSA tuning of the evaluation parameters through self-play. Each iteration perturbs every
+// parameter at once in a random direction, plays a batch of games between the two perturbed
+// engines, and moves the parameters towards the winner in proportion to its margin. Engines
+// search to a fixed node budget rather than a time limit, so the result measures the quality of
+// the evaluation and not its speed. Only the parameters used by the chosen evaluator are tuned.
+
+// Bounds on each parameter, and the size of the perturbation applied to it
+class ParamRange {
+public:
+    int minimum;
+    int maximum;
+    double perturbation;
+};
+
+const ParamRange ranges[EVAL_PARAMS] = {
+    {50, 100, 4},       // shared room penalty, %
+    {0, 50, 4},         // unvisited room bonus, %
+    {0, 10, 1},         // door penalty
+    {100, 3000, 100}    // death penalty
+};
+
+inline double clampParam(int param, double value) {
+    return min(double(ranges[param].maximum), max(double(ranges[param].minimum), value));
+}
+
+void roundParams(const double theta[EVAL_PARAMS], EvalParams& params) {
+    for (int i = 0; i < EVAL_PARAMS; i++) {
+        params[i] = int(floor(clampParam(i, theta[i]) + 0.5));
+    }
+}
+
+void usage(const char* name) {
+    cerr << "Usage: " << name << " [-n iterations] [-g games] [-j threads] [-N nodes] [-d depth] [-p players]..."
+        << " [-s seed] [-a step] [-e evaluator] [-i initial_params] [-o params.txt]" << endl;
+    cerr << "  -g  games per iteration" << endl;
+    cerr << "  -N  search nodes per move" << endl;
+    cerr << "  -a  first step, in perturbations, for a 60% score" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 200;
+    long games = 64;
+    int threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    unsigned seed = 1;
+    double step = 1;
+    const char* outputPath = "params.txt";
+    vector<int> playerCounts;
+    Engine engine;
+    engine.name = "tune";
+    engine.timeLimit = 0;
+    engine.nodeLimit = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:j:N:d:p:s:a:e:i:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'g':
+            games = atol(optarg);
+            break;
+        case 'j':
+            threads = max(1, atoi(optarg));
+            break;
+        case 'N':
+            engine.nodeLimit = atoi(optarg);
+            break;
+        case 'd':
+            engine.maxDepth = atoi(optarg);
+            break;
+        case 'p':
+            playerCounts.push_back(min(PLAYERS, max(2, atoi(optarg))));
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'a':
+            step = atof(optarg);
+            break;
+        case 'e':
+            if (!engine.set("eval", optarg)) {
+                cerr << "Unknown evaluator " << optarg << endl;
+                return 1;
+            }
+            break;
+        case 'i':
+            if (!engine.set("params", optarg)) {
+                cerr << "Cannot read evaluation parameters from " << optarg << endl;
+                return 1;
+            }
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (playerCounts.empty()) {
+        for (int players = 2; players <= PLAYERS; players++) {
+            playerCounts.push_back(players);
+        }
+    }
+
+    double theta[EVAL_PARAMS];
+    for (int i = 0; i < EVAL_PARAMS; i++) {
+        theta[i] = engine.params[i];
+    }
+    // Standard SPSA gain sequences: a_k = a / (A + k + 1)^0.602 and c_k = 1 / (k + 1)^0.101
+    double stability = iterations / 10.0;
+    double a = step * 10 * pow(stability + 1, 0.602);
+
+    cout << "Tuning " << engine.describe() << endl;
+    cout << setw(5) << "iter" << setw(8) << "score";
+    for (int i = 0; i < EVAL_PARAMS; i++) {
+        cout << setw(22) << evalParamNames[i];
+    }
+    cout << endl;
+
+    for (int k = 0; k < iterations; k++) {
+        double ak = a / pow(stability + k + 1, 0.602);
+        double ck = 1 / pow(k + 1.0, 0.101);
+        int delta[EVAL_PARAMS];
+        vector<Engine> engines(2, engine);
+        engines[0].name = "plus";
+        engines[1].name = "minus";
+        double plus[EVAL_PARAMS];
+        double minus[EVAL_PARAMS];
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            bool used = (engine.variant->params >> i) & 1;
+            delta[i] = used ? (rand_r(&seed) % 2 ? 1 : -1) : 0;
+            plus[i] = theta[i] + ck * ranges[i].perturbation * delta[i];
+            minus[i] = theta[i] - ck * ranges[i].perturbation * delta[i];
+        }
+        roundParams(plus, engines[0].params);
+        roundParams(minus, engines[1].params);
+
+        Match match(engines, playerCounts, games, rand_r(&seed));
+        match.run(threads);
+        double score = match.tallies[0][1].score();
+
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            theta[i] = clampParam(i, theta[i] + ranges[i].perturbation * ak * (2 * score - 1) / (2 * ck) * delta[i]);
+        }
+
+        cout << setw(5) << k + 1 << fixed << setprecision(3) << setw(8) << score << setprecision(2);
+        for (int i = 0; i < EVAL_PARAMS; i++) {
+            cout << setw(22) << theta[i];
+        }
+        cout << endl;
+
+        // Keep the current estimate on disk, so that a long run can be stopped at any time
+        EvalParams best;
+        roundParams(theta, best);
+        ofstream os(outputPath);
+        best.write(os);
+    }
+    cout << "Parameters written to " << outputPath << endl;
+    return 0;
+}
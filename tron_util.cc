@@ -0,0 +1,613 @@
+// Helpers shared by the tests and the offline tools. Include after tron.cc.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define CORPUS_PATH "positions.txt"
+
+void readBoard(State& state, istream& is) {
+    Player players[PLAYERS];
+    for (int i = 0; i < PLAYERS; i++) {
+        players[i].x = -1;
+    }
+    string line;
+    int y = 0;
+    while (getline(is, line)) {
+        for (unsigned x = 0; x < line.size(); x++) {
+            char cell = line[x];
+            int player = cell - '0';
+            if (player >= 0 && player < PLAYERS) {
+                state.occupy(x, y, player);
+            } else {
+                player = cell - 'A';
+                if (player >= 0 && player < PLAYERS) {
+                    players[player].x = x;
+                    players[player].y = y;
+                }
+            }
+        }
+        y++;
+    }
+    for (unsigned i = 0; i < PLAYERS; i++) {
+        if (players[i].x >= 0) {
+            state.occupy(players[i].x, players[i].y, i);
+            state.numPlayers = i + 1;
+        }
+    }
+}
+
+void readBoard(State& state, const char* board) {
+    istringstream is(board);
+    readBoard(state, is);
+}
+
+inline const char* parseMove(const string& name) {
+    for (int i = 0; i < 4; i++) {
+        if (name == dirs[i]) {
+            return dirs[i];
+        }
+    }
+    return name == GULP ? GULP : 0;
+}
+
+// A named position from the corpus file (see positions.txt for the format)
+class Position {
+public:
+    string name;
+    State state;
+    vector<const char*> expected;
+    vector<const char*> avoided;
+    // known leaf counts by depth, for perft
+    vector<long> perft;
+
+    Position() {
+        // Until a players, board or turn directive sizes the game, any seat on the board may be named
+        state.numPlayers = PLAYERS;
+        state.thisPlayer = 0;
+        state.timeLimitEnabled = false;
+    }
+
+    // Whether the position has a known right answer
+    inline bool hasSolution() const {
+        return !expected.empty() || !avoided.empty();
+    }
+
+    inline bool solvedBy(const char* move) const {
+        if (!expected.empty() && find(expected.begin(), expected.end(), move) == expected.end()) {
+            return false;
+        }
+        return find(avoided.begin(), avoided.end(), move) == avoided.end();
+    }
+
+    string solution() const {
+        string s;
+        for (unsigned i = 0; i < expected.size(); i++) {
+            s += (s.empty() ? "" : " ") + string(expected[i]);
+        }
+        for (unsigned i = 0; i < avoided.size(); i++) {
+            s += (s.empty() ? "!" : " !") + string(avoided[i]);
+        }
+        return s;
+    }
+};
+
+// Collect lines up to "end" into a single string
+bool readBlock(istream& is, string& block) {
+    string line;
+    while (getline(is, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line == "end") {
+            return true;
+        }
+        block += line + "\n";
+    }
+    return false;
+}
+
+bool loadCorpus(istream& is, vector<Position>& positions) {
+    string line;
+    int lineNumber = 0;
+    while (getline(is, line)) {
+        lineNumber++;
+        istringstream ls(line);
+        string key;
+        if (!(ls >> key) || key[0] == '#') {
+            continue;
+        }
+        if (key == "position") {
+            positions.push_back(Position());
+            ls >> positions.back().name;
+            continue;
+        }
+        if (positions.empty()) {
+            cerr << "Line " << lineNumber << ": directive before first position" << endl;
+            return false;
+        }
+
+        Position& position = positions.back();
+        State& state = position.state;
+        bool ok = true;
+        if (key == "players") {
+            ok = !(ls >> state.numPlayers).fail() && state.numPlayers > 0 && state.numPlayers <= PLAYERS;
+        } else if (key == "me") {
+            ok = !(ls >> state.thisPlayer).fail();
+        } else if (key == "depth") {
+            ok = !(ls >> state.maxDepth).fail();
+        } else if (key == "margin") {
+            ok = !(ls >> state.pruneMargin).fail();
+        } else if (key == "pruning") {
+            string value;
+            ok = !(ls >> value).fail();
+            state.pruningEnabled = value == "on";
+        } else if (key == "kill") {
+            int player;
+            ok = !(ls >> player).fail() && player >= 0 && player < state.numPlayers;
+            if (ok) {
+                state.kill(player);
+            }
+        } else if (key == "head") {
+            int player;
+            ok = !(ls >> player).fail() && player >= 0 && player < state.numPlayers;
+            ok = ok && !(ls >> state.players[player].x >> state.players[player].y).fail();
+        } else if (key == "board") {
+            string board;
+            ok = readBlock(is, board);
+            readBoard(state, board.c_str());
+        } else if (key == "turn") {
+            string turn;
+            ok = readBlock(is, turn);
+            istringstream ts(turn);
+            state.readTurn(ts);
+        } else if (key == "perft") {
+            int depth;
+            long count;
+            ok = !(ls >> depth >> count).fail() && depth >= 0;
+            if (ok) {
+                if ((int) position.perft.size() <= depth) {
+                    position.perft.resize(depth + 1, -1);
+                }
+                position.perft[depth] = count;
+            }
+        } else if (key == "expect" || key == "avoid") {
+            vector<const char*>& moves = key == "expect" ? position.expected : position.avoided;
+            string name;
+            while (ok && ls >> name) {
+                const char* move = parseMove(name);
+                ok = move != 0;
+                moves.push_back(move);
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cerr << "Line " << lineNumber << ": bad directive in position " << position.name << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadCorpus(const char* path, vector<Position>& positions) {
+    ifstream is(path);
+    if (!is) {
+        cerr << "Cannot open " << path << endl;
+        return false;
+    }
+    return loadCorpus(is, positions);
+}
+
+// Set up a single named position from the corpus
+bool loadPosition(State& state, const char* name, const char* path = CORPUS_PATH) {
+    vector<Position> positions;
+    if (!loadCorpus(path, positions)) {
+        return false;
+    }
+    for (unsigned i = 0; i < positions.size(); i++) {
+        if (positions[i].name == name) {
+            state = positions[i].state;
+            return true;
+        }
+    }
+    cerr << "No position " << name << " in " << path << endl;
+    return false;
+}
+
+// Draw random straight walls (as player 0's trail) over the board
+template <class Board>
+void randomlyPopulate(BasicState<Board>& state, int walls) {
+    const int maxX = Board::width - 1;
+    const int maxY = Board::height - 1;
+    for (int i = 0; i < walls; i++) {
+        int x = rand() % maxX;
+        int y = rand() % maxY;
+        int size = rand() % 10;
+        if (rand() % 2 == 0) {
+            for (int yy = y; yy <= maxY && yy - y <= size; yy++) {
+                state.occupy(x, yy, 0);
+            }
+        } else {
+            for (int xx = x; xx <= maxX && xx - x <= size; xx++) {
+                state.occupy(xx, y, 0);
+            }
+        }
+    }
+}
+
+// Put each player's head on a random free cell
+template <class Board>
+void placePlayers(BasicState<Board>& state, int numPlayers) {
+    state.numPlayers = numPlayers;
+    state.thisPlayer = 0;
+    for (int i = 0; i < numPlayers; i++) {
+        int x, y;
+        do {
+            x = rand() % Board::width;
+            y = rand() % Board::height;
+        } while (state.occupied(x, y));
+        state.occupy(x, y, i);
+    }
+}
+
+#define DENSITIES 3
+
+const char* const densityNames[DENSITIES] = {"sparse", "medium", "dense"};
+const int densityWalls[DENSITIES] = {5, 15, 35};
+
+// A reproducible random board for benchmarking. Bigger boards get walls in proportion to their area.
+template <class Board>
+void benchmarkBoard(BasicState<Board>& state, int numPlayers, int density, unsigned seed) {
+    srand(seed);
+    randomlyPopulate(state, densityWalls[density] * Board::area / StandardBoard::area);
+    placePlayers(state, numPlayers);
+    state.timeLimitEnabled = false;
+}
+
+// Summary statistics over a set of samples
+class Stats {
+public:
+    int count;
+    double mean;
+    double median;
+    double p99;
+    double minimum;
+    double stddev;
+
+    Stats(vector<double> samples) {
+        sort(samples.begin(), samples.end());
+        count = samples.size();
+        mean = median = p99 = minimum = stddev = 0;
+        if (count == 0) {
+            return;
+        }
+        double total = 0;
+        for (int i = 0; i < count; i++) {
+            total += samples[i];
+        }
+        mean = total / count;
+        double squares = 0;
+        for (int i = 0; i < count; i++) {
+            squares += (samples[i] - mean) * (samples[i] - mean);
+        }
+        stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+        median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+        p99 = samples[min(count - 1, int(ceil(count * 0.99)) - 1)];
+        minimum = samples[0];
+    }
+};
+
+// Two-sided 95% critical value of Student's t distribution
+double tCritical(double df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df < 1) {
+        return table[0];
+    } else if (df <= 30) {
+        return table[int(df) - 1];
+    } else if (df <= 60) {
+        return 2.000 + (60 - df) * (2.042 - 2.000) / 30;
+    } else if (df <= 120) {
+        return 1.980 + (120 - df) * (2.000 - 1.980) / 60;
+    }
+    return 1.960;
+}
+
+// Half-width of the 95% confidence interval of the mean
+inline double confidence(const Stats& stats) {
+    return stats.count > 1 ? tCritical(stats.count - 1) * stats.stddev / sqrt(double(stats.count)) : 0;
+}
+
+// Welch's t-test: whether two sets of samples have significantly different means
+bool significantlyDifferent(double mean1, double stddev1, int n1, double mean2, double stddev2, int n2) {
+    if (n1 < 2 || n2 < 2) {
+        return false;
+    }
+    double v1 = stddev1 * stddev1 / n1;
+    double v2 = stddev2 * stddev2 / n2;
+    if (v1 + v2 == 0) {
+        return mean1 != mean2;
+    }
+    double t = fabs(mean1 - mean2) / sqrt(v1 + v2);
+    double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    return t > tCritical(df);
+}
+
+// Count the leaves of the game tree to the given depth, following the turn rules of minimax:
+// dead players pass, without using up a ply when groups are searched apart, a player with no
+// legal move dies, and once only one player is left alive the remaining plies pass without moves.
+// With verify set, every unmade move is checked to restore the board exactly.
+long perft(State& state, int turn, int depth, bool verify = false) {
+    if (turn >= depth) {
+        return 1;
+    }
+    int player = (state.thisPlayer + turn) % state.numPlayers;
+    if (!state.isAlive(player) || state.livingCount() == 1) {
+        return perft(state, turn + 1, depth + freePass(state), verify);
+    }
+
+    // only copied when verifying, as a state is not cheap to make
+    const State* before = verify ? new State(state) : 0;
+
+    long count = 0;
+    bool moved = false;
+    int origX = state.players[player].x;
+    int origY = state.players[player].y;
+    for (int i = 0; i < 4; i++) {
+        int x = origX + xOffsets[i];
+        int y = origY + yOffsets[i];
+        if (!state.occupied(x, y)) {
+            state.makeMove(player, x, y);
+            count += perft(state, turn + 1, depth, verify);
+            state.unmakeMove();
+            moved = true;
+            if (verify && !state.sameBoard(*before)) {
+                cerr << "Board not restored after player " << player << " moved " << dirs[i] << " at ply " << turn << endl;
+                state.print();
+                abort();
+            }
+        }
+    }
+    if (!moved) {
+        state.makeDeath(player);
+        count += perft(state, turn + 1, depth, verify);
+        state.unmakeMove();
+        if (verify && !state.sameBoard(*before)) {
+            cerr << "Board not restored after player " << player << " died at ply " << turn << endl;
+            state.print();
+            abort();
+        }
+    }
+    delete before;
+    return count;
+}
+
+// The standard evaluator, also counting the leaves it scores, so that costs can be reported per
+// leaf as well as per node
+class LeafCounter {
+public:
+    Voronoi voronoi;
+    long leaves;
+
+    LeafCounter() : leaves(0) {}
+};
+
+void countingRecursive(Scores& scores, Bounds& bounds, State& state, int turn, void* sc, void* data) {
+    LeafCounter& counter = *(LeafCounter*) data;
+    if (turn >= state.getMaxDepth()) {
+        counter.leaves++;
+        calculateScores(scores, counter.voronoi, state, turn);
+    } else {
+        minimax(scores, bounds, state, turn, sc, data);
+    }
+}
+
+// Leaves scored by a search of the position with the standard evaluator
+long countLeaves(const State& s) {
+    State state = s;
+    static LeafCounter counter;
+    counter.leaves = 0;
+    Scores scores;
+    Bounds bounds;
+    minimax(scores, bounds, state, 0, (void*) countingRecursive, &counter);
+    return counter.leaves;
+}
+
+// Hardware performance counters for this thread, read through perf_event_open. Each counter is
+// opened on its own, so that one the CPU lacks does not lose the others; counters the kernel
+// refuses (no PMU in a VM, perf_event_paranoid too high) read as -1. When the kernel multiplexes
+// counters, the counts are scaled up to the whole measured interval.
+enum PerfCounter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_COUNTERS
+};
+
+const char* const perfCounterNames[PERF_COUNTERS] = {
+    "cycles", "instructions", "L1d misses", "LLC misses", "branch misses"
+};
+
+class PerfCounters {
+private:
+    int fds[PERF_COUNTERS];
+
+    static int openCounter(unsigned type, unsigned long long config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+public:
+    long values[PERF_COUNTERS];
+    // why the first counter that failed could not be opened
+    string error;
+
+    PerfCounters() {
+        const unsigned types[PERF_COUNTERS] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+        };
+        const unsigned long long configs[PERF_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            fds[i] = openCounter(types[i], configs[i]);
+            values[i] = -1;
+            if (fds[i] < 0 && error.empty()) {
+                error = string(perfCounterNames[i]) + ": " + strerror(errno);
+            }
+        }
+    }
+
+    ~PerfCounters() {
+        disable();
+    }
+
+    // Close the counters, leaving timing only
+    void disable() {
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+        error.clear();
+    }
+
+    bool available() const {
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start() {
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop() {
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            uint64_t data[3];   // value, time enabled, time running
+            values[i] = -1;
+            if (fds[i] >= 0 && read(fds[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+                values[i] = long(double(data[0]) * data[1] / data[2]);
+            }
+        }
+    }
+};
+// Write a table of entries with distinct keys, which need not be sorted, for MappedTable
+template <class Entry>
+bool writeTable(const char* path, vector<Entry> entries) {
+    sort(entries.begin(), entries.end());
+    TableHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Entry::magic, 4);
+    header.version = Entry::version;
+    header.width = WIDTH;
+    header.height = HEIGHT;
+    header.players = PLAYERS;
+    header.entries = entries.size();
+    // about one entry per bucket
+    while ((size_t(1) << header.bucketBits) < entries.size()) {
+        header.bucketBits++;
+    }
+    vector<uint32_t> starts((size_t(1) << header.bucketBits) + 1);
+    for (unsigned i = 0, bucket = 0; bucket < starts.size(); bucket++) {
+        while (i < entries.size() && tableBucket(entries[i].key, header.bucketBits) < bucket) {
+            i++;
+        }
+        starts[bucket] = i;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && (entries.empty() || fwrite(&entries[0], sizeof(Entry), entries.size(), file) == entries.size())
+        && fwrite(&starts[0], sizeof(uint32_t), starts.size(), file) == starts.size();
+    return fclose(file) == 0 && written;
+}
+
+// Write a book, keeping the deeper of any entries with the same key
+bool writeBook(const char* path, vector<BookEntry> entries) {
+    sort(entries.begin(), entries.end());
+    vector<BookEntry> unique;
+    for (unsigned i = 0; i < entries.size(); i++) {
+        if (!unique.empty() && unique.back().key == entries[i].key) {
+            if (entries[i].depth > unique.back().depth) {
+                unique.back() = entries[i];
+            }
+        } else {
+            unique.push_back(entries[i]);
+        }
+    }
+    return writeTable(path, unique);
+}
+
+// The most cells a player can visit from its head in a pocket, by trying every path
+class FillSearch {
+public:
+    static const int SIZE = 2 * POCKET_CELLS + 3;
+    bool free[SIZE][SIZE];
+    int cells;
+    int best;
+
+    void search(int x, int y, int length) {
+        best = max(best, length);
+        for (int i = 0; i < 4 && best < cells; i++) {
+            int xx = x + xOffsets[i];
+            int yy = y + yOffsets[i];
+            if (free[xx][yy]) {
+                free[xx][yy] = false;
+                search(xx, yy, length + 1);
+                free[xx][yy] = true;
+            }
+        }
+    }
+};
+
+int longestFill(const Pocket& pocket) {
+    FillSearch fill;
+    memset(fill.free, 0, sizeof(fill.free));
+    const int centre = POCKET_CELLS + 1;
+    for (int i = 0; i < pocket.size; i++) {
+        fill.free[centre + pocket.dx[i]][centre + pocket.dy[i]] = true;
+    }
+    fill.cells = pocket.size;
+    fill.best = 0;
+    fill.search(centre, centre, 0);
+    return fill.best;
+}